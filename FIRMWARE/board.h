@@ -0,0 +1,78 @@
+/****************************************************************************************************************************************************************************
+ *  FILE NAME     : board.h
+ *  Description   : Pin assignments of every ignition board revision (BOARD/3.0 ... BOARD/3.4)
+ *  Target        : PIC 16F1824
+ *  Copyright     : SKYWARD EXPERIMENTAL ROCKETRY
+ *
+ * DESCRIPTION
+ * The revision is chosen at compile time with BOARD_REV (30 ... 34, default 33), e.g. adding BOARD_REV=32 to the
+ * preprocessor macros of the project (PICC --define). Everything here is a define: a profile costs nothing at
+ * runtime, the image of a revision contains only its own pins.
+ *
+ * Common to every revision (checked on the schematics):
+ * -> RA5 is the clock input from the YodaBoard, through R1 (470) with R2 (100k) pull down;
+ * -> JP1 closes RA4 on RA5 (input disable);
+ * -> RA0/RA1 are ICSP, RA3 is VPP.
+ *
+ *  REV | SCHEMATIC  | MOS GATE (through R3) | LED IGNITION  | LED LINK      | FREE PADS
+ *  3.0 | ignition3  | RA2                   | RC0 (PAD6)    | RC1 (PAD8)    | RC2-RC5
+ *  3.1 | ignition4  | RA2                   | RC2 (LED1)    | RC1 (LED2)    | RC0, RC3-RC5
+ *  3.2 | ignition5  | RA2                   | RC0 (LED1)    | RC1 (LED2)    | RC2-RC5
+ *  3.3 | ignition6  | RC5                   | RC0 (LED1)    | RC1 (LED2)    | RA2, RC2-RC4
+ *  3.4 | ignition7  | RC5                   | RC0 (LED1)    | RC1 (LED2)    | RA2, RC2-RC4
+ * 3.0 has no leds on board: RC0/RC1 are brought to pads, for external ones.
+ * The free PORTC pads can be extra igniter channels (each through an external MOS, see firePlan[] in main.c). They
+ * are driven only where a board wires them: BOARD_CHANNELS, none by default (the MOS gate alone fires).
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#ifndef BOARD_REV
+#define BOARD_REV       33          ///> revision built when none is given
+#endif
+
+/***************************************************************************************************************
+ *                                                 PROFILES                                                    *
+ ***************************************************************************************************************/
+
+#if BOARD_REV == 30 || BOARD_REV == 32
+#define LED_IGNITION    LATCbits.LATC0 ///> Led for ignition signalling pin
+#define LED_LINK        LATCbits.LATC1 ///> Led for succesful linkage with the main board pin
+#define MOS_GATE        LATAbits.LATA2 ///> MOS gate pin
+#define BOARD_FREE_LATC 0b00111100     ///> PORTC pins brought to free pads: the extra igniter channels (firePlan[] in main.c)
+#define BOARD_GATE_CCP1 0              ///> the MOS gate is on RC5, the CCP1 pin: its compare can turn it on by hardware
+#define BOARD_GATE_LATC 0b00000000     ///> the MOS gate as a LATC bit, when it's on PORTC: it goes on in the same write as the channels
+
+#elif BOARD_REV == 31
+#define LED_IGNITION    LATCbits.LATC2
+#define LED_LINK        LATCbits.LATC1
+#define MOS_GATE        LATAbits.LATA2
+#define BOARD_FREE_LATC 0b00111001
+#define BOARD_GATE_CCP1 0
+#define BOARD_GATE_LATC 0b00000000
+
+#elif BOARD_REV == 33 || BOARD_REV == 34
+#define LED_IGNITION    LATCbits.LATC0
+#define LED_LINK        LATCbits.LATC1
+#define MOS_GATE        LATCbits.LATC5
+#define BOARD_FREE_LATC 0b00011100
+#define BOARD_GATE_CCP1 1
+#define BOARD_GATE_LATC 0b00100000
+
+#else
+#error "BOARD_REV must be 30, 31, 32, 33 or 34"
+#endif
+
+//Same on every revision
+#define INPUT_DISABLE   LATAbits.LATA4 ///> Pin to keep the counter stopped by hardware (JP1 shortcircuits it to the RA5 input)
+#define BOARD_INLVLA    0b00000000     ///> RA5 through R1/R2 reaches 2V as logic "1": TTL input levels, with schmitt trigger it would need 0.8VDD
+
+//Igniter channels of the board being built, as LATC bits: given per board (e.g. PICC --define BOARD_CHANNELS=0x1C on a
+//3.3 with igniters on RC2-RC4), none by default. Only free pads are ever driven.
+#ifndef BOARD_CHANNELS
+#define BOARD_CHANNELS  0x00
+#endif
+#define BOARD_CHANNEL_LATC ((BOARD_CHANNELS) & BOARD_FREE_LATC) ///> the channels driven: enabled and on a free pad
+
+#endif
@@ -0,0 +1,63 @@
+/****************************************************************************************************************************************************************************
+ *  FILE NAME     : hal.h
+ *  Description   : Hardware abstraction for the Ignition Firmware
+ *  Target        : PIC 16F1824 (HI-TECH C), x86-64 Linux (gcc) for native tests
+ *  Copyright     : SKYWARD EXPERIMENTAL ROCKETRY
+ *
+ * DESCRIPTION
+ * main.c includes this file instead of <htc.h>. On the PIC it is <htc.h> plus a few macros, so the firmware compiles
+ * to exactly the same code. Built with any other compiler it pulls in hal_host.h, an in-memory model of the registers
+ * main.c uses: the same firmware logic then runs natively, and a test program can drive the registers and check the
+ * outputs without the board.
+ *
+ * Only what main.c needs is abstracted, with macros: no function call, no pointer, nothing left at runtime.
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+/***************************************************************************************************************
+ *                                                 LIBRARIES                                                   *
+ ***************************************************************************************************************/
+#ifdef HI_TECH_C
+#include <htc.h> //default library for basic registers defines
+#else
+#include "hal_host.h" //register model for native builds
+#define main firmwareMain //the test program owns main()
+#endif
+
+/***************************************************************************************************************
+ *                                                   DEFINE                                                    *
+ ***************************************************************************************************************/
+
+//TIMER1 (free running, 1us counts)
+//! Current time in t (unsigned int). TMR1 keeps running: high byte, low byte, then the high byte again; if TMR1L
+// carried in between the pair is read again (once at most, the next carry is 256 us away).
+#define TMR1_READ(t)    do { (t) = TMR1H; (t) = ((t) << 8) | TMR1L; } while(((t) >> 8) != TMR1H)
+
+//CAPTURE (CCP2 copies TMR1, 1us counts, in CCPR2 at every rising edge on RA5, see sfrConfig[] in main.c)
+#define CCP2_EDGE()     (CCP2IF)                                            ///> an edge came
+#define CCP2_CLEAR()    (CCP2IF = 0)                                        ///> edge served
+#define CCP2_READ()     ((unsigned int)(((unsigned int)CCPR2H << 8) | CCPR2L)) ///> TMR1 at the last edge
+
+//COMPARE (CCP1 flags, and may set its pin, when TMR1 reaches CCPR1)
+#define CCP1_MATCH()    (CCP1IF)                                            ///> TMR1 reached CCPR1
+#define CCP1_CLEAR()    (CCP1IF = 0)                                        ///> match served
+#define CCP1_LOAD(t)    do { CCPR1H = (t) >> 8; CCPR1L = (t); } while(0)   ///> TMR1 value to match
+
+//TIMER2 (TMR2IF rises every 1 ms)
+#define TICK()          (TMR2IF)                                            ///> a tick came
+#define TICK_CLEAR()    (TMR2IF = 0)                                        ///> tick served
+
+//MAIN LOOP and 16 bit arithmetic
+#ifdef HI_TECH_C
+#define HAL_POLL()                                                          ///> the hardware runs by itself
+#define U16(x)          (x)                                                 ///> int is 16 bit: TMR1 differences wrap by themselves
+#define S16(x)          ((int)(x))                                          ///> signed TMR1 difference
+#else
+#define HAL_POLL()      halHostDelayUs(HAL_HOST_POLL_US)                    ///> the time of the model advances at every pass
+#define U16(x)          ((x) & 0xFFFF)                                      ///> int is wider: TMR1 differences wrap here
+#define S16(x)          ((int)(short)(x))                                   ///> and take their sign here
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+/****************************************************************************************************************************************************************************
+ *  FILE NAME     : hal_host.c
+ *  Description   : Storage of the register model declared in hal_host.h
+ *  Target        : x86-64 Linux (gcc), never built for the PIC
+ *  Copyright     : SKYWARD EXPERIMENTAL ROCKETRY
+*/
+
+#define HAL_HOST_DEFINE
+#include "hal_host.h"
+
+volatile unsigned char halHostEeprom[256] = { [0 ... 255] = 0xFF }; //erased, as a new chip: address 0
+
+unsigned long t1Cycles = 0; //Instruction cycles not yet counted by the TMR1 prescaler
+unsigned long t2Cycles = 0; //Instruction cycles since the last TMR2IF
+
+//\brief Time of the firmware passing: the simulated time advances, TMR1 counts, the CCP1 compare and TMR2 tick, then the
+// test program gets its turn. The timers follow their registers, so an upset of T1CON, T2CON or PR2 shows: TMR1 counts
+// instruction cycles (FOSC/4, 4 per us) through its prescaler while TMR1ON is set, TMR2IF rises every (PR2 + 1) *
+// prescaler * postscaler cycles while TMR2ON is set. A compare match sets CCP1IF, and in the set/clear pin modes
+// drives RC5 through LATC (the CCP1 pin overrides the latch on the PIC; here the latch holds it until rewritten).
+void halHostDelayUs(unsigned long us)
+{
+    unsigned long cycles = us * 4; //instruction cycles
+    unsigned int tmr1 = (TMR1H << 8) | TMR1L;
+    unsigned long counts = 0; //TMR1 counts
+    unsigned long period2 = (PR2 + 1UL) * ((T2CON & 0x02) ? 16 : (T2CON & 0x01) ? 4 : 1) * (((T2CON >> 3) & 0x0F) + 1);
+
+    if(T1CON & 0x01) //TMR1ON
+    {
+        t1Cycles += cycles;
+        counts = t1Cycles >> ((T1CON >> 4) & 0x03); //T1CKPS
+        t1Cycles -= counts << ((T1CON >> 4) & 0x03);
+        if((CCP1CON & 0x08) && ((unsigned int)(((CCPR1H << 8) | CCPR1L) - tmr1 - 1) & 0xFFFF) < counts) //compare mode, match
+        {
+            CCP1IF = 1;
+            if((CCP1CON & 0x0F) == 0x08)
+                LATC |= 0x20;
+            else if((CCP1CON & 0x0F) == 0x09)
+                LATC &= ~0x20;
+        }
+        tmr1 += counts;
+        TMR1L = tmr1;
+        TMR1H = tmr1 >> 8;
+    }
+    if(T2CON & 0x04) //TMR2ON
+    {
+        t2Cycles += cycles;
+        if(t2Cycles >= period2)
+        {
+            TMR2IF = 1;
+            t2Cycles %= period2;
+        }
+    }
+    halHostTimeUs += us;
+    if(halHostOnDelay)
+        halHostOnDelay(us);
+}
@@ -0,0 +1,113 @@
+/****************************************************************************************************************************************************************************
+ *  FILE NAME     : hal_host.h
+ *  Description   : In-memory register model of the PIC 16F1824, for native builds of main.c
+ *  Target        : x86-64 Linux (gcc)
+ *  Copyright     : SKYWARD EXPERIMENTAL ROCKETRY
+ *
+ * DESCRIPTION
+ * Included by hal.h when the compiler is not HI-TECH C. Every register main.c touches is a plain variable (defined
+ * in hal_host.c), with the same name and the same bit fields as in <htc.h>, so main.c builds unchanged.
+ * Only the time is emulated (TMR1, the CCP1 compare and TMR2IF, following T1CON, CCP1CON, T2CON and PR2, see
+ * halHostDelayUs()): any other register holds what was last written to it, by the firmware or by the test program.
+ * The test program drives the model:
+ *  -> it sets the inputs (CCP2IF/CCPR2H/CCPR2L, PORTA, the data EEPROM halHostEeprom[]...) and reads the outputs
+ *     (LATC, LATA...);
+ *  -> __delay_ms()/__delay_us() and every pass of the main loop (HAL_HOST_POLL_US) advance halHostTimeUs, set TMR2IF
+ *     at every millisecond and call halHostOnDelay, if set, so the test can change the registers while the
+ *     firmware runs (e.g. capture the time of an edge in CCPR2);
+ *  -> hal.h renames the main() of the firmware firmwareMain(): the test program has its own main(), includes only
+ *     this file and calls the firmware functions.
+ * Build: gcc -c main.c hal_host.c, then link with the test program (test/host_test.c, make host-test).
+*/
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#ifdef HAL_HOST_DEFINE //hal_host.c defines the registers, everybody else sees them extern
+#define HOST_EXTERN
+#else
+#define HOST_EXTERN extern
+#endif
+
+/***************************************************************************************************************
+ *                                          COMPILER INTRINSICS                                                *
+ ***************************************************************************************************************/
+
+#define __CONFIG(x)                                     ///> configuration words exist only in the hex file
+#define NOP()           ((void)0)
+#define CLRWDT()        ((void)0)
+#define __delay_us(x)   halHostDelayUs(x)
+#define __delay_ms(x)   halHostDelayUs((unsigned long)(x) * 1000UL)
+#define HAL_HOST_POLL_US 5                              ///> time of a pass of the main loop
+
+HOST_EXTERN unsigned long halHostTimeUs;                ///> simulated time, advanced by the delays
+HOST_EXTERN void (*halHostOnDelay)(unsigned long us);   ///> called by every delay, after the time advanced
+extern volatile unsigned char halHostEeprom[256];       ///> data EEPROM, erased (0xFF) at start: EEDATL is its byte at EEADRL
+void halHostDelayUs(unsigned long us);
+void firmwareMain(void);
+
+/***************************************************************************************************************
+ *                                              REGISTERS                                                      *
+ ***************************************************************************************************************/
+
+//! A register with bit fields, name.reg is the byte and name.bits the fields (LSB first, as in <htc.h>)
+#define HOST_SFR_BITS(name, b0, b1, b2, b3, b4, b5, b6, b7) \
+    typedef union { unsigned char reg; struct { unsigned b0:1, b1:1, b2:1, b3:1, b4:1, b5:1, b6:1, b7:1; } bits; } name##_t; \
+    HOST_EXTERN volatile name##_t host##name
+
+//! A register without bit fields
+#define HOST_SFR(name) HOST_EXTERN volatile unsigned char name
+
+HOST_SFR_BITS(LATA,   LATA0, LATA1, LATA2, LATA3, LATA4, LATA5, LATA6, LATA7);
+HOST_SFR_BITS(LATC,   LATC0, LATC1, LATC2, LATC3, LATC4, LATC5, LATC6, LATC7);
+HOST_SFR_BITS(PORTA,  RA0, RA1, RA2, RA3, RA4, RA5, RA6, RA7);
+HOST_SFR_BITS(TRISA,  TRISA0, TRISA1, TRISA2, TRISA3, TRISA4, TRISA5, TRISA6, TRISA7);
+HOST_SFR_BITS(PIR1,   TMR1IF, TMR2IF, CCP1IF, SSP1IF, TXIF, RCIF, ADIF, TMR1GIF);
+HOST_SFR_BITS(PIR2,   CCP2IF, PIR2_1, PIR2_2, BCL1IF, EEIF, C1IF, C2IF, OSFIF);
+HOST_SFR_BITS(EECON1, RD, WR, WREN, WRERR, FREE, LWLO, CFGS, EEPGD);
+
+#define LATA        hostLATA.reg
+#define LATAbits    hostLATA.bits
+#define LATC        hostLATC.reg
+#define LATCbits    hostLATC.bits
+#define PORTA       hostPORTA.reg
+#define PORTAbits   hostPORTA.bits
+#define TRISA       hostTRISA.reg
+#define TRISAbits   hostTRISA.bits
+#define PIR1        hostPIR1.reg
+#define TMR2IF      hostPIR1.bits.TMR2IF
+#define CCP1IF      hostPIR1.bits.CCP1IF
+#define PIR2        hostPIR2.reg
+#define CCP2IF      hostPIR2.bits.CCP2IF
+#define EECON1      hostEECON1.reg
+#define EECON1bits  hostEECON1.bits
+
+HOST_SFR(OSCCON);
+HOST_SFR(OPTION_REG);
+HOST_SFR(WDTCON);
+HOST_SFR(ANSELA);
+HOST_SFR(ANSELC);
+HOST_SFR(INLVLA);
+HOST_SFR(TRISC);
+HOST_SFR(T1CON);
+HOST_SFR(TMR1L);    ///> TMR1H/TMR1L count with the time as T1CON sets them: the free running 1us TMR1 of main.c
+HOST_SFR(TMR1H);
+HOST_SFR(APFCON1);
+HOST_SFR(CCP1CON);
+HOST_SFR(CCPR1L);
+HOST_SFR(CCPR1H);
+HOST_SFR(CCP2CON);
+HOST_SFR(CCPR2L);
+HOST_SFR(CCPR2H);
+HOST_SFR(PR2);
+HOST_SFR(T2CON);
+HOST_SFR(EEADRL);
+HOST_SFR(EEADRH);
+#define EEDATL      halHostEeprom[EEADRL] ///> program memory reads see it too: there is no program memory, see __DEBUG
+HOST_SFR(EEDATH);
+HOST_SFR(FSR0L);
+HOST_SFR(FSR0H);
+HOST_SFR(FSR1L);
+HOST_SFR(INDF0);    ///> a plain byte: indirect addressing is not modelled, ramTest() always passes
+
+#endif
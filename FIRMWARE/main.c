@@ -12,15 +12,24 @@
  *  Copyright     : SKYWARD EXPERIMENTAL ROCKETRY
  *
  * DESCRIPTION
- * The program uses the TIMER 1 with clock input on pin RA5 to recognize the frequency of a PWM signal from the main
- * board (YodaBoard). It supports two different frequencies:
- * -> The IGNITION_MIN~IGNITION_MAX range defines that we are ready to launch and we will activate the gate of the MOS that ignites the spark to start the rocket.
+ * The program uses the CCP2 capture on pin RA5 to recognize the frequency of a PWM signal from the main board (YodaBoard):
+ * every rising edge is timed by TIMER 1 (1us), so every period is classified as it ends. It supports:
+ * -> The arming code, four tones of TONE_A~TONE_D in the order of armCode[], each held 40 ms, arms the board.
+ * -> The IGNITION_MIN~IGNITION_MAX range, held for IGNITE_HOLD_US within ARM_WINDOW_MS of the arming, defines that we are ready to launch
+ *   and we will activate the gate of the MOS that ignites the spark to start the rocket. Without the arming it is ignored.
+ * -> Once armed, a burst of N periods of COUNT_MIN~COUNT_MAX (N >= COUNT_PERIODS_MIN), with a silence before and
+ *   after, fires the board N * COUNT_UNIT_US after its last edge, timed by the CCP1 compare, even if the link is lost meanwhile.
+ * -> The ABORT_MIN~ABORT_MAX range turns the MOS off and disarms the board ABORT_PERIODS periods after it starts (~1.5 ms).
  * -> The YODA_MIN~YODA_MAX range is a "link test" frequency that turns on the green led on the board to let the user know that everything is fine
- *   on the link between the YodaBoard and this circuit.
+ *   on the link between the YodaBoard and this circuit. Its edges also discipline TIMER 1 to the YodaBoard crystal
+ *   (syncEdge()): the estimated drift of the internal oscillator corrects the countdown.
  *
- * The program is kept very simple for fast usage. A future version may use interrupts with a timer instead of a blocking delay function in main (highly inaccurate)..
+ * Several boards can share one YodaBoard output: the ignite and countdown bands above are those of address 0, the
+ * address stored in the data EEPROM selects another pair from addrBands[] (arming, abort and link are common to all).
  *
- * The PCB is designed by Stefano  (stefano.marino@skywarder.eu), with revision 3.3.
+ * The program is kept very simple for fast usage: no interrupts, the main loop polls the edges and the 1 ms tick of TIMER 2.
+ *
+ * The PCB is designed by Stefano  (stefano.marino@skywarder.eu), revisions 3.0 to 3.4 (see board.h, 3.3 by default).
  * 
  *
  * RELEASE HISTORY:
@@ -30,24 +39,91 @@
 /***************************************************************************************************************
  *                                                 LIBRARIES                                                   *
  ***************************************************************************************************************/
-#include <htc.h> //default library for basic registers defines
+#include "hal.h" //registers: <htc.h> on the PIC, the register model of hal_host.h on a PC
+#include "board.h" //pins of the board revision selected with BOARD_REV
 
 /***************************************************************************************************************
  *                                                   DEFINE                                                    *
  ***************************************************************************************************************/
 
-//PORTS
-#define LED_IGNITION    LATCbits.LATC0 ///> Led for ignition signalling pin
-#define LED_LINK        LATCbits.LATC1 ///> Led for succesful linkage with the main board pin
-#define MOS_GATE        LATCbits.LATC5 ///> MOS gate pin
-#define INPUT_DISABLE   LATAbits.LATA4 ///> Pin to keep the counter stopped by hardware (shortcircuited to the RC5 input)
-
 //COSTANTS
 #define _XTAL_FREQ      16000000    ///> Necessary for hi-tech c delay routines
 #define IGNITION_MIN    300         ///> minimum frequency in hertz accepted for the ignition of the spark plug
 #define IGNITION_MAX    600         ///> maximum frequency in hertz accepted for the ignition of the spark plug
 #define YODA_MIN        4500        ///> minimum frequency in hertz accepted for the link check
 #define YODA_MAX        5500        ///> maximum frequency in hertz accepted for the link check
+#define ABORT_MIN       3300        ///> minimum frequency in hertz accepted for the abort
+#define ABORT_MAX       3900        ///> maximum frequency in hertz accepted for the abort
+#define ABORT_PERIODS   4           ///> consecutive periods of the abort tone that abort (<= 1.2 ms of tone)
+#define COUNT_MIN       2050        ///> minimum frequency in hertz accepted for the countdown burst
+#define COUNT_MAX       2350        ///> maximum frequency in hertz accepted for the countdown burst
+#define US(hz)          ((unsigned int)(1000000UL / (hz))) ///> period in microseconds (TMR1 counts) of a tone at hz
+
+//ARMING CODE (four tones, each held 40 ms: see armCode[])
+#define TONE_A_MIN      720         ///> tone A, 800 Hz +-10%
+#define TONE_A_MAX      880
+#define TONE_B_MIN      1080        ///> tone B, 1200 Hz +-10%
+#define TONE_B_MAX      1320
+#define TONE_C_MIN      1620        ///> tone C, 1800 Hz +-10%
+#define TONE_C_MAX      1980
+#define TONE_D_MIN      2430        ///> tone D, 2700 Hz +-10%
+#define TONE_D_MAX      2970
+#define SYMBOL_MIN_US   30000       ///> shortest tone accepted as a code symbol (nominal 40 ms)
+#define SYMBOL_MAX_US   50000       ///> longest tone accepted as a code symbol
+#define TONE_US_MAX     60000       ///> toneUs saturates here (TMR1 wraps at 65535)
+
+//TIMING (milliseconds, counted by the 1 ms tick of TMR2)
+#define ARM_WINDOW_MS   5000        ///> once armed, the ignite tone is accepted only for this long
+#define IGNITE_HOLD_US  40000       ///> the ignite tone must last this long, in the arm window, to fire
+#define SILENCE_MS      5           ///> no edge for this long ends the tone (longer than the slowest period, 4.2 ms at 240 Hz)
+#define LINK_BLINK_MS   1000        ///> half period of the link led heartbeat
+#define LOCKOUT_MS      10000       ///> after a firing every command is ignored for this long, then a new arming is needed (max 65535)
+#define COUNT_UNIT_US   100000UL    ///> countdown time of each period of the burst (COUNT_PERIODS_MIN to 254 periods: 1 s to 25.4 s)
+#define COUNT_PERIODS_MIN 10        ///> shorter bursts are no count (a glitch of a few periods between two silences must not fire)
+#define COUNT_FINAL_MS  40          ///> the CCP1 compare is loaded this long before the fire time (TMR1 wraps every 65 ms)
+#define COUNT_FIRE_MS   2000        ///> a countdown fires for this long, with or without the link
+
+//CLOCK SYNC (the YodaBoard makes the link check tone from its crystal: its edges are the reference of TMR1, see syncEdge())
+#define SYNC_HZ         5000        ///> link check frequency the YodaBoard generates
+#define SYNC_PERIOD_Q8  ((unsigned int)US(SYNC_HZ) << 8) ///> its period in TMR1 counts of an exact 1 MHz, 1/256 us units
+#define SYNC_BAND_US    5           ///> only link periods within US(SYNC_HZ) +-2.5% are a reference (INTOSC is +-2% at worst)
+#define SYNC_DRIFT_MAX  1024        ///> syncDrift is kept within +-2% of SYNC_PERIOD_Q8, what INTOSC can need
+#define SYNC_ERR_MAX    20          ///> a phase error over this (us) is a lost or extra edge: the phase is taken again
+#define SYNC_LOCK       64          ///> periods of acquisition gains, then of tracking ones (12.8 ms)
+#define SYNC_ODD_MAX    3           ///> link periods out of the SYNC_HZ band in a row that stop the tracking (fewer are jitter)
+
+//SELF TEST
+#define FLASH_SUM_ADDR  0x0FFF      ///> program word holding the reference checksum, written at link time (see --CHECKSUM in nbproject)
+#define FLASH_CHUNK     819         ///> words summed in each of the 5 startup led cycles (5*819 = every word below FLASH_SUM_ADDR)
+#define FLASH_CHUNK_MS  8           ///> about the time a chunk takes, taken away from the led cycle delay
+#define RAM_BANK_H      0x20        ///> high byte of the linear address of banked RAM (0x2000 = bank 0 GPR)
+#define RAM_END_L       0xF0        ///> low byte of the linear address after the last banked RAM byte (3 banks * 80 bytes)
+
+//ADDRESSING (data EEPROM: the address at ADDR_EEPROM, its complement at ADDR_EEPROM+1; erased means address 0)
+#define ADDR_EEPROM     0x00        ///> data EEPROM byte holding the board address, e.g. __EEPROM_DATA(2, 0xFD, ...) for address 2
+
+//INPUT INTERLOCK (JP1 closes RA4 on RA5: RA4 driven low holds the counter input at 0V, through R1 at most 7mA)
+#define INPUT_CLOSE()   do { INPUT_DISABLE = OFF; TRISAbits.TRISA4 = OUTPUT; } while(0) ///> no edge can reach CCP2
+#define INPUT_OPEN()    (TRISAbits.TRISA4 = INPUT)                                     ///> RA4 floating, RA5 follows the YodaBoard
+
+//COMMANDS
+#define CMD_NONE        0           ///> no known frequency read, waiting for connection
+#define CMD_IGNITION    1           ///> ignition frequency read
+#define CMD_LINK        2           ///> link check frequency read
+#define CMD_TONE_A      3           ///> arming code tones
+#define CMD_TONE_B      4
+#define CMD_TONE_C      5
+#define CMD_TONE_D      6
+#define CMD_ABORT       7           ///> abort frequency read
+#define CMD_COUNT       8           ///> countdown burst frequency read
+
+//STATES (codes are several bits apart, so that a corrupted value is never mistaken for another state)
+#define STATE_WAITING   0x3C        ///> no command, waiting for connection
+#define STATE_LINK      0x5A        ///> link check frequency received
+#define STATE_ARMED     0xC3        ///> arming code received, ignite tone accepted until armMs runs out
+#define STATE_FIRING    0xA5        ///> ignition frequency received, MOS gate on
+#define STATE_LOCKOUT   0x66        ///> fired, commands ignored and input closed until lockoutMs runs out
+#define STATE_COUNTDOWN 0x99        ///> countdown received, CCP1 fires at fireAt
 
 //GENERAL UTILITY
 #define ON          1
@@ -98,235 +174,877 @@ __CONFIG(WRT_OFF & PLLEN_OFF & STVREN_OFF & BORV_HI & LVP_OFF);
  *                                          GLOBAL VARIABLES                                                   *
  ***************************************************************************************************************/
 
-unsigned int freq = 0; //Variable that has the last ridden frequency
+unsigned int period = 0; //Microseconds between the last two rising edges on RA5
+unsigned int lastCapture = 0; //TMR1 at the last rising edge
+unsigned char captureValid = FALSE; //lastCapture belongs to the tone being received (FALSE after a silence)
+unsigned char sfrUpsets = 0; //Number of configuration registers found corrupted and repaired by scrubSfr() (saturates at 255)
+unsigned char scrubNext = 0; //Entry of sfrConfig[] scrubSfr() checks next
+unsigned char tone = CMD_NONE; //Tone being received
+unsigned int toneUs = 0; //For how long it has been received (saturates at TONE_US_MAX)
+unsigned char tonePeriods = 0; //Periods it has been received for (saturates at 255)
+unsigned int toneStart = 0; //TMR1 at the edge it started with
+unsigned char toneOdd = CMD_NONE; //Band of a single period that differs from the tone
+unsigned int toneOddUs = 0; //Its length (0: none, the last period was of the tone)
+unsigned int abortUsMax = 0; //Longest abort latency measured, from the start of the abort tone to the MOS off
+unsigned char silenceMs = 0; //Time since the last rising edge (saturates at SILENCE_MS)
+unsigned int linkMs = 0; //Time since the link led last toggled
+unsigned char toneQuiet = TRUE; //The tone being received started after a silence
+unsigned int fireT0 = 0; //TMR1 when the MOS gate went on, the origin of firePlan[]
+unsigned char fireStep = 0; //Step of firePlan[] due next
+unsigned long syncPhase = 0; //TMR1 (1/256 us units, low 24 bits) of the last YodaBoard link edge as estimated: the offset of the two clocks
+int syncDrift = 0; //TMR1 counts per YodaBoard link period minus the nominal (1/256 us units, 1 = 19.5 ppm): the drift of INTOSC
+int syncError = 0; //Phase error of the last link edge (us), measured edge minus estimated one
+unsigned char syncLock = 0; //Link periods tracked since the phase was taken (saturates at SYNC_LOCK: syncDrift is valid)
+unsigned char syncOdd = 0; //Link periods out of the SYNC_HZ band in a row (saturates at SYNC_ODD_MAX)
+
+//! Arming code: the tones, in order, each held 40 ms (two equal neighbours would read as one longer tone).
+// Any other tone, a symbol too short or too long, or a silence restarts it from the first symbol.
+const unsigned char armCode[] = { CMD_TONE_A, CMD_TONE_D, CMD_TONE_B, CMD_TONE_C };
+
+#define ARM_CODE_SIZE (sizeof(armCode)/sizeof(armCode[0])) ///> number of symbols in armCode[]
+
+
+//! Safety-critical byte stored three times, read through tmrRead() and written through tmrWrite().
+typedef struct
+{
+    unsigned char a;
+    unsigned char b;
+    unsigned char c;
+} tmr8_t;
+
+//! Safety-critical word stored three times, read through tmr16Read() and written through tmr16Write().
+typedef struct
+{
+    unsigned int a;
+    unsigned int b;
+    unsigned int c;
+} tmr16_t;
+
+tmr8_t state = { STATE_WAITING, STATE_WAITING, STATE_WAITING }; //State of the board, the outputs are driven only from this
+tmr8_t codeNext = { 0, 0, 0 }; //Symbol of armCode[] expected next: one flipped copy can't skip symbols
+tmr16_t countdownMs = { 0, 0, 0 }; //Time left before the CCP1 compare is loaded
+tmr16_t fireAt = { 0, 0, 0 }; //TMR1 at the fire time of the countdown
+tmr16_t fireMs = { 0, 0, 0 }; //Time left in a countdown firing (0 for an ignite tone firing, it lasts as the tone)
+tmr16_t armMs = { 0, 0, 0 }; //Time left in the arm window
+tmr16_t lockoutMs = { 0, 0, 0 }; //Time left in the post-fire lockout
+tmr8_t channels = { 0, 0, 0 }; //LATC bits of the igniter channels fired so far, on only in STATE_FIRING
+
+//! Step of the firing plan: channels turned on together, delayUs after the MOS gate.
+typedef struct
+{
+    unsigned int delayUs;          ///> microseconds after the MOS gate (steps in order, the last within ~60 ms)
+    unsigned char latc;            ///> channels, as LATC bits (within BOARD_CHANNEL_LATC)
+} fireStep_t;
+
+//! Firing plan of the extra igniter channels: the free pads the board wires (BOARD_CHANNEL_LATC, none unless
+// BOARD_CHANNELS is given), each driving the MOS of its own igniter. Every firing, ignite tone or countdown, goes through it from the start. The channels of a step
+// go on with a single LATC write, within one instruction cycle of each other; steps with the same delayUs are one
+// step. Later steps are timed by the CCP1 compare, to the microsecond, and served within a pass of the main loop.
+// Default: every channel enabled in the first step, with the gate (the gate alone on a board without channels). Staged ignition, e.g.:
+//   { 0, 0b00000100 }, { 1500, 0b00011000 }   --> RC2 with the MOS gate, RC3 and RC4 1.5 ms later
+// The channels have no state machine of their own: arming, abort, lockout and the end of the firing are those of
+// the board (state) and act on every channel at once, so no channel can be left on, or armed, by itself. The state of
+// a channel is only off/on, its bit in channels. Adding a step: update the @bound of fireStepNext() as well.
+const fireStep_t firePlan[] =
+{
+    { 0, BOARD_CHANNEL_LATC },
+};
+
+#define FIRE_PLAN_SIZE (sizeof(firePlan)/sizeof(firePlan[0])) ///> number of steps in firePlan[]
+#define FIRE_PLAN_SPAN_US (firePlan[FIRE_PLAN_SIZE - 1].delayUs) ///> delay of the last step (keep it within ~60 ms, TMR1 wraps at 65.5)
+#define FIRE_STEP_MARGIN_US 10      ///> a step due closer than this is not loaded in the compare, it is added at once
+
+//! Bands of the commands addressed to a single board, as periods: a period p is in a band when (p - min) <= width.
+typedef struct
+{
+    unsigned int ignitionMin;      ///> shortest period of the ignite tone
+    unsigned int ignitionWidth;    ///> longest minus shortest
+    unsigned int countMin;         ///> shortest period of the countdown burst
+    unsigned int countWidth;
+} addrBands_t;
+
+#define BAND(hzMin, hzMax) US(hzMax), (US(hzMin) - US(hzMax)) ///> band of periods of a range of frequencies
+
+//! Ignite and countdown bands of each board address. They sit in the gaps between the common bands (code tones,
+// abort, link check) and between each other, their centre 5% or more from any other band. One compare each, whatever the
+// number of boards on the line: classify() only looks at the row of this board. The countdown bursts stay below
+// 3.3 kHz, at least 300us a period: onEdge() plus onTick() fit in one of them.
+const addrBands_t addrBands[] =
+{
+    { BAND(IGNITION_MIN, IGNITION_MAX), BAND(COUNT_MIN, COUNT_MAX) }, // address 0:  450 Hz, 2200 Hz (single board)
+    { BAND(620, 700),                   BAND(1360, 1580) },           // address 1:  660 Hz, 1470 Hz
+    { BAND(920, 1040),                  BAND(3020, 3250) },           // address 2:  980 Hz, 3135 Hz
+    { BAND(4000, 4400),                 BAND(240, 280) },             // address 3: 4200 Hz,  260 Hz
+};
+
+#define BOARD_ADDRESSES (sizeof(addrBands)/sizeof(addrBands[0])) ///> number of board addresses
+
+tmr8_t address = { 0, 0, 0 }; //Board address, row of addrBands[], read from the data EEPROM by addressLoad()
+
+//! Value of a configuration register, written by init() and checked by scrubSfr().
+typedef struct
+{
+    volatile unsigned char *reg;   ///> register to write
+    unsigned char value;           ///> value to write
+    unsigned char check;           ///> bits scrubSfr() checks (the others are changed at runtime)
+} sfrConfig_t;
+
+#define SFR_ALL         0xFF        ///> every bit of the register is checked
+
+//! Board configuration: only the registers whose value differs from the reset default.
+// init() writes them in this order, scrubSfr() keeps checking them, so only registers that read back
+// what was written belong here (no flags, no status bits).
+// Everything else is left at its reset value: comparators, DAC, ADC, CCP1, TMR4/6, capacitive sensing, FVR and the
+// data signal modulator are off, the TMR1 gate is ignored (TMR1GE = 0), every interrupt is disabled and its flag cleared.
+const sfrConfig_t sfrConfig[] =
+{
+    //--OSCILLATOR--//------------------------------------------------------------------------------------------------
+    { &OSCCON,      0b01111010, SFR_ALL },    // 0       --> spll disabled (it works only if activated in the configuration word)
+                                              // 1111    --> 16 Mhz
+                                              // 0       --> not used
+                                              // 1x      --> System Clock Select, internal clock
+
+    //--OPTION REGISTER--//-------------------------------------------------------------------------------------------
+    { &OPTION_REG,  0b10001000, SFR_ALL },    // 1   --> Weak pull up disabled
+                                              // 0   --> Interrupt on rising edge on RA2 disabled
+                                              // 0   --> TMR0 uses internal clock
+                                              // 0   --> TMR0 increments with low-to-high
+                                              // 1   --> prescaler to WDT
+                                              // 000 --> prescaler is 1:2
+
+    //--WATCHDOG--//--------------------------------------------------------------------------------------------------
+    { &WDTCON,      0b00000000, SFR_ALL },    // 00        --> not used
+                                              // 00000     --> 1ms prescaler
+                                              // 00        --> Watchdog off
+
+    //--INPUT/OUTPUT--//----------------------------------------------------------------------------------------------
+    { &ANSELA,      0b00000000, SFR_ALL },    // we only use digital logics (an analog RA5 would never reach CCP2)
+    { &ANSELC,      0b00000000, SFR_ALL },
+    { &INLVLA,      BOARD_INLVLA, SFR_ALL },  // input levels of the board
+    { &TRISA,       0b00101000, 0b11101111 }, // RA0-RA2 outputs (RA0/RA1 are ICSP, RA2 MOS gate up to board 3.2)
+                                              // RA3 VPP, input only
+                                              // RA4 output low, input interlock closed (main() opens it after the self test, not checked)
+                                              // RA5 input, signal from YodaBoard
+    { &TRISC,       0b00000000, SFR_ALL },    // leds, MOS gate from board 3.3 and free pads: all outputs
+
+    //--TIMER1--//-----------------------------------------------------------------------------------------------------
+    { &T1CON,       0b00100001, SFR_ALL },    // 00      --> TMR1CS Timer1 clock source is FOSC/4
+                                              // 10      --> T1CKPS 1:4 prescaler, 1us counts: the time base of CCP2
+                                              // 0       --> T1OSCEN TMR1 dedicated oscillator disabled
+                                              // 0       --> T1SYNC (ignored with FOSC/4)
+                                              // 0       --> Not used
+                                              // 1       --> TMR1ON timer on, free running
+
+    //--TIMER2--//-----------------------------------------------------------------------------------------------------
+    { &PR2,         249,        SFR_ALL },    // 250 counts of 4us: TMR2IF every 1 ms, the tick
+    { &T2CON,       0b00000110, SFR_ALL },    // 0       --> Not used
+                                              // 0000    --> T2OUTPS 1:1 postscaler
+                                              // 1       --> TMR2ON timer on
+                                              // 10      --> T2CKPS 1:16 prescaler (FOSC/4 = 4 MHz)
+
+    //--CAPTURE--//----------------------------------------------------------------------------------------------------
+    { &APFCON1,     0b00000001, SFR_ALL },    // 1       --> CCP2SEL CCP2 on RA5 (P2B stays on RC2, unused)
+    { &CCP2CON,     0b00000101, SFR_ALL },    // 00      --> P2M unused
+                                              // 00      --> DC2B unused
+                                              // 0101    --> capture TMR1 in CCPR2 at every rising edge, CCP2IF set
+};
+
+#define SFR_CONFIG_SIZE (sizeof(sfrConfig)/sizeof(sfrConfig[0])) ///> number of registers in sfrConfig[]
 
 /***************************************************************************************************************
  *                                                 FUNCTIONS                                                   *
  ***************************************************************************************************************/
 
 //\brief Initialization function
+// Latches first: their reset value is unknown, and TRISA/TRISC turn the MOS gate pin into an output.
+// Then the configuration table, oscillator first.
 void init()
 {
-    //--OSCILLATOR--//------------------------------------------------------------------------------------------------
+    unsigned char i = 0; //variable used in the for cycle
 
-    OSCCON=0b01111010;   // 0       --> spll disabled (it works only if activated in the configuration word)
-                         // 1111    --> 16 Mhz
-                         // 0       --> not used
-                         // 1x      --> System Clock Select, internal clock
+    LATA = 0;
+    LATC = 0;
 
-    //--OPTION REGISTER--//-------------------------------------------------------------------------------------------
+    for(i=0;i<SFR_CONFIG_SIZE;i++) //@bound 13 (entries of sfrConfig[])
+        *sfrConfig[i].reg = sfrConfig[i].value;
+}
 
-    OPTION_REG=0b10001000; // 1   --> Weak pull up disabled
-                           // 0   --> Interrupt on rising edge on RA2 disabled
-                           // 0   --> TMR0 uses internal clock
-                           // 0   --> TMR0 increments with low-to-high
-                           // 1   --> prescaler to WDT
-                           // 000 --> prescaler is 1:2
 
-    //--WATCHDOG--//--------------------------------------------------------------------------------------------------
+//\brief Delay function
+// Input the number of desired delay milliseconds. MAX 65535.
+// Used only before the main loop (self test) and by selftestFail(): applyState() doesn't run, so the MOS gate is
+// written off here every millisecond, a flipped latch bit can't hold it on.
+void delayerMs(unsigned int delay)
+{
+        unsigned int i = 0; //variabile per il ciclo for
+        
+        for(i=0;i<delay;i++) //ritardo di delay ms (@bound 100, the longest delay asked)
+        {
+                 MOS_GATE = OFF;
+                 __delay_ms(1); 
+        }
+}
 
-    WDTCON = 0b000000000;  // 00        --> not used
-                           // 00000     --> 1ms prescaler
-                           // 00        --> Watchdog off
 
-   //--INPUT/OUTPUT--//----------------------------------------------------------------------------------------------
+//\brief Triple-redundant write
+// Stores the value in all three copies.
+void tmrWrite(tmr8_t *v, unsigned char value)
+{
+        v->a = value;
+        v->b = value;
+        v->c = value;
+}
 
-    ANSELA = 0b00000000; // we only use digital logics
-    ANSELC = 0b00000000;
 
-    INLVLA = 0b00000000; //every input is TTL, we have 2v as logic "1". With schmitt trigger it would be 0.8VDD
-    TRISA = 0b00111000;  //details follow below
-    TRISC = 0b00000000;  //details follow below
+//\brief Triple-redundant read
+// Returns the bitwise majority of the three copies and writes it back to all of them, so that a single upset
+// is both outvoted and repaired. No branches: it always takes the same time (~20 cycles).
+unsigned char tmrRead(tmr8_t *v)
+{
+        unsigned char m = 0; //majority value
 
+        m = (v->a & v->b) | (v->a & v->c) | (v->b & v->c);
+        tmrWrite(v, m);
 
+        return m;
+}
 
-//    TRISAbits.TRISA0=OUTPUT; //PIN DAC not used
-//    TRISAbits.TRISA1=OUTPUT; //PIN not used
-//    TRISAbits.TRISA2=OUTPUT;  //PIN not used
-//    TRISAbits.TRISA3=INPUT;  //VPP not used (only for programming, input only pin)
-//    TRISAbits.TRISA4=INPUT; //PIN for optional clock bypass (it "disables" the clock from the YodaBoard by forcing 0V on RA5).
-                                //we're not using it right now, we keep it as input.
-//    TRISAbits.TRISA5=INPUT;  //PIN for clock input from YodaBoard
-//
-//    ANSELAbits.ANSA0 = DIGITAL;//PIN  DIGITAL
-//    ANSELAbits.ANSA1 = DIGITAL;//PIN DIGITAL
-//    ANSELAbits.ANSA2 = DIGITAL;//PIN DIGITAL
-//    ANSELAbits.ANSA4 = DIGITAL;//PIN DIGITAL   
 
-//    TRISCbits.TRISC0=OUTPUT; //PIN LED 1
-//    TRISCbits.TRISC1=OUTPUT;  //PIN LED 2
-//    TRISCbits.TRISC2=OUTPUT; //PIN not used
-//    TRISCbits.TRISC3=OUTPUT;  //PIN not used
-//    TRISCbits.TRISC4=OUTPUT; //PIN not used
-//    TRISCbits.TRISC5=OUTPUT;  //PIN MOS GATE
-//
-//    ANSELCbits.ANSC0 = DIGITAL; //PIN DIGITAL
-//    ANSELCbits.ANSC1 = DIGITAL; //PIN DIGITAL
-//    ANSELCbits.ANSC2 = DIGITAL;//PIN DIGITAL
-//    ANSELCbits.ANSC3 = DIGITAL;//PIN DIGITAL
+//\brief Triple-redundant word write
+// Stores the value in all three copies.
+void tmr16Write(tmr16_t *v, unsigned int value)
+{
+        v->a = value;
+        v->b = value;
+        v->c = value;
+}
 
 
-    //PORTS RESET.
-    PORTA = 0;
-    PORTC = 0;
+//\brief Triple-redundant word read
+// Same as tmrRead(), on 16 bits: the bitwise majority, written back to the three copies (~40 cycles).
+unsigned int tmr16Read(tmr16_t *v)
+{
+        unsigned int m = 0; //majority value
 
-    //LATCHS RESET
-    LATA = 0;
-    LATC = 0;
+        m = (v->a & v->b) | (v->a & v->c) | (v->b & v->c);
+        tmr16Write(v, m);
 
+        return m;
+}
 
-    //--CAPACITIVE SENSING--//
 
-    CPSCON0 = 0b00000000; //disabled
+//\brief Output refresh
+// Drives LEDs, MOS gate and igniter channels from the voted state. Only STATE_FIRING turns the gate and the channels
+// on: any other value, even a corrupted one, keeps them off. The link led is left alone in STATE_LINK, onTick() makes
+// it blink.
+void applyState(void)
+{
+        unsigned char st = tmrRead(&state); //voted state
 
-    //--COMPARATORS--//
+        switch(st)
+        {
+            case STATE_FIRING:
+                LED_IGNITION = ON; //turning on the ignition led
+                LED_LINK = OFF; //turning off the link led (because is for test only)
+                LATC |= (tmrRead(&channels) & BOARD_CHANNEL_LATC) | BOARD_GATE_LATC; //one write: the channels due, and the MOS gate when it's on PORTC
+                MOS_GATE = ON; //Turning on the MOSFET (giving power to the spark plug)
+                break;
+
+            case STATE_ARMED:
+                LED_IGNITION = ON; //both leds on: armed, the next ignite tone fires
+                LED_LINK = ON;
+                MOS_GATE = OFF; //not yet
+                break;
+
+            case STATE_COUNTDOWN:
+                LED_IGNITION = ON; //counting down to the ignition
+                LED_LINK = OFF;
+                MOS_GATE = OFF; //the CCP1 compare turns it on (BOARD_GATE_CCP1 without channels), or countdownFire()
+                break;
+
+            case STATE_LOCKOUT:
+                LED_IGNITION = OFF; //both leds off: fired, deaf until the lockout is over
+                LED_LINK = OFF;
+                MOS_GATE = OFF;
+                break;
+
+            case STATE_LINK:
+                LED_IGNITION = OFF; //if it's for link check, this led should be off.
+                MOS_GATE = OFF; //the spark plug must be off, it's a good thing to remember it!
+                break;
+
+            default: //waiting for connection (or an unknown value)
+                LED_IGNITION = OFF; //ignition led is off because
+                MOS_GATE = OFF; //the MOSFET (and spark plug) is off
+                LED_LINK = ON; // but the led link is CONSTANTLY on, indicating that the processor is succesfully powered on and waiting.
+                break;
+        }
+
+        if(st != STATE_FIRING) //every igniter channel off
+                LATC &= (unsigned char)~BOARD_CHANNEL_LATC;
+
+        if((st != STATE_COUNTDOWN) && (st != STATE_FIRING)) //the compare may drive the MOS gate: it is on only to count down, then to time firePlan[]
+                CCP1CON = 0;
+}
 
-    CM1CON0 = 0b00000000; //disabling first comparator
-    CM1CON1 = 0b00000000;
-    CM2CON0 = 0b00000000; //disabling second comparator
-    CM2CON1 = 0b00000000;
 
-    //--FIXED VOLTAGE REFERENCE--//
-    FVRCON = 0b00000000; //we're not using it
+//\brief SFR integrity scrubber
+// Compares one register of sfrConfig[] with the value init() wrote, the next one at every call, repairs the checked
+// bits if they changed (an EMI event near the igniter can flip configuration bits) and counts it in sfrUpsets.
+// About 25 cycles: called at every pass of the main loop, not by the tick, so it also repairs the timer of the tick
+// (T2CON, PR2): the whole table is checked every 13 passes, well within a millisecond.
+void scrubSfr(void)
+{
+        unsigned char upset = 0; //checked bits that differ from the table
+
+        if(scrubNext >= SFR_CONFIG_SIZE) //the index itself upset: never a pointer from outside sfrConfig[]
+                scrubNext = 0;
+        upset = (*sfrConfig[scrubNext].reg ^ sfrConfig[scrubNext].value) & sfrConfig[scrubNext].check;
+        if(upset != 0)
+        {
+                *sfrConfig[scrubNext].reg ^= upset; //repairing only them: the runtime bits (TRISA4, the interlock) stay as they are
+                if(sfrUpsets != 0xFF)
+                        sfrUpsets++;
+        }
+        if(++scrubNext >= SFR_CONFIG_SIZE)
+                scrubNext = 0;
+}
+
 
-    //--DATA SIGNAL MODULATOR--//
-    MDCON = 0b00000000; //disabled
+//\brief Period classifier
+// Input the microseconds between two rising edges, returns the CMD_xxx command (or code tone) they stand for.
+// Every band costs a single compare: (p - MIN) wraps around to a huge unsigned number when p < MIN,
+// so (p - MIN) <= (MAX - MIN) is true only for MIN <= p <= MAX. The bounds are periods (the highest frequency
+// is the shortest period), converted and folded by the compiler; the addressed ones are read from the row of
+// addrBands[] of the voted address.
+// Always 8 bands: the other boards on the line cost nothing, their tones are simply CMD_NONE here.
+unsigned char classify(unsigned int p)
+{
+        unsigned char addr = 0; //voted board address
 
-    
-    //--A/D CONVERTER--//-------------------------------------------------------------------------------------------
+        if((unsigned int)(p - US(ABORT_MAX)) <= (US(ABORT_MIN) - US(ABORT_MAX))) //abort first, it's the one in a hurry
+                return CMD_ABORT;
 
-/*  ________________________________________________________________________________
-    |   PORTA   |      ANALOG PORT      |   ADCON0   |         FUNCTION            |
-    -------------------------------------------------------------------------------|
-    |   RA1     |           AN1         | 0b00000111 |  debug only, not used       |
-    |------------------------------------------------------------------------------|
-*/
+        addr = tmrRead(&address);
+        if(addr >= BOARD_ADDRESSES) //more than one copy upset: no addressed command at all
+                return CMD_NONE;
 
-    ADCON1=0b00100000;   //0        --> Left justified
-                         //010      --> FOSC/32
-                         //0        --> not used
-                         //0        --> negative ref is VSS
-                         //00       --> positive ref is VDD
+        if((unsigned int)(p - addrBands[addr].ignitionMin) <= addrBands[addr].ignitionWidth) //Checking if it's the frequency for ignition of this board
+                return CMD_IGNITION;
 
-    //--D/A CONVERTER--//-------------------------------------------------------------------------------------------
+        if((unsigned int)(p - US(YODA_MAX)) <= (US(YODA_MIN) - US(YODA_MAX))) //if it's not for ignition, maybe it's for signal check
+                return CMD_LINK;
 
+        if((unsigned int)(p - US(TONE_A_MAX)) <= (US(TONE_A_MIN) - US(TONE_A_MAX))) //or one of the arming code
+                return CMD_TONE_A;
 
-    DACCON0=0b01000000;  // 0   --> DAC is disabled
-                         // 1   --> DAC Positive reference source selected
-                         // 0   --> DAC logics are off
-                         // 0   --> not used
-                         // 01  --> positive source is FVR BUFFER 2
-                         // 00  --> not used
-    DACCON1=0b00000000;  // 5 bit with the DAC value
+        if((unsigned int)(p - US(TONE_B_MAX)) <= (US(TONE_B_MIN) - US(TONE_B_MAX)))
+                return CMD_TONE_B;
 
+        if((unsigned int)(p - US(TONE_C_MAX)) <= (US(TONE_C_MIN) - US(TONE_C_MAX)))
+                return CMD_TONE_C;
 
-    //--PWM--//--------------------------------------------------------------------------------------------------------
+        if((unsigned int)(p - US(TONE_D_MAX)) <= (US(TONE_D_MIN) - US(TONE_D_MAX)))
+                return CMD_TONE_D;
 
-    CCP1CON = 0b00000000;  // 00      --> PWM MODE, single output, P1A modulated, P1B,C,D are I/O.
-                           // 00      --> LSBs of PWM duty cycle (called DC1B 1 and 2)
-                           // 0000    --> PWM OFF
+        if((unsigned int)(p - addrBands[addr].countMin) <= addrBands[addr].countWidth) //the countdown burst of this board
+                return CMD_COUNT;
 
-    CCPR1L = 0;            // PWM duty cycle = 0%
+        return CMD_NONE;
+}
 
-    
-    PSTR1CON = 0b00000000; // we're using default pins
 
+//\brief Post-fire lockout
+// Every firing ends here (ignite tone over or abort): for LOCKOUT_MS the board ignores every command, with the
+// input closed by the interlock, then it goes back to waiting and needs the whole arming code again.
+// A repeated or reflected ignite command can't fire twice, whatever reaches RA5.
+void lockoutStart(void)
+{
+        tmrWrite(&state, STATE_LOCKOUT);
+        applyState(); //MOS_GATE = OFF now, not at the next tick
+        tmr16Write(&lockoutMs, LOCKOUT_MS);
+        tmrWrite(&codeNext, 0);
+        INPUT_CLOSE();
+}
 
 
-    //--TIMER1--//-----------------------------------------------------------------------------------------------------
+//\brief End of a tone
+// Called when the tone being received changes or falls silent, with tone and toneUs still describing it.
+// The ignite tone ending stops a firing and starts the lockout. A code tone is the next symbol of armCode[] if it
+// lasted SYMBOL_MIN_US to SYMBOL_MAX_US, anything else restarts the code: when the last symbol is in, the board is
+// armed for ARM_WINDOW_MS.
+void toneEnd(void)
+{
+        unsigned char st = tmrRead(&state); //voted state
+        unsigned char next = tmrRead(&codeNext); //voted code progress
+
+        if(next >= ARM_CODE_SIZE) //more than one copy upset: never an index out of armCode[]
+                next = 0;
+
+        if((st == STATE_FIRING) && (tone == CMD_IGNITION)) //the ignite tone stopped: MOS off, lockout
+                lockoutStart();
+
+        if((st == STATE_FIRING) || (st == STATE_LOCKOUT) || (st == STATE_COUNTDOWN) || ((unsigned int)(toneUs - SYMBOL_MIN_US) > (SYMBOL_MAX_US - SYMBOL_MIN_US)))
+                next = 0; //not a symbol
+        else if(tone == armCode[next])
+                next++;
+        else if(tone == armCode[0]) //a wrong symbol may be the start of a new code
+                next = 1;
+        else
+                next = 0;
+
+        if(next == ARM_CODE_SIZE) //the whole code is in
+        {
+                next = 0;
+                tmr16Write(&armMs, ARM_WINDOW_MS);
+                tmrWrite(&state, STATE_ARMED);
+        }
+        tmrWrite(&codeNext, next);
+}
 
-    T1CON = 0b10000100;  // 10      --> TMR1CS Timer1 clock source is pin
-                         // 00      --> T1CKPS 1:1 prescaler
-                         // 0       --> T1OSCEN TMR1 dedicated oscillator disabled
-                         // 1       --> T1SYNC do not sync TMR1 with FOSC
-                         // 0       --> Not used
-                         // 0       --> TMR1ON timer off
-    
-    T1GCON = 0b01000100; // 0       --> TMR1GE  gate function ignored
-                         // 1       --> T1GPOL  TMR1 counts if gate is high (not used bc TMR1GE is off)
-                         // 0       --> T1GTM timer1 toggle mode disabled
-                         // 0       --> T1GSPM single pulse mode disabled
-                         // 0       --> T1GGO/nDONE single pulse acquisition not started
-                         // 0       --> T1GVAL gate current state bit
-                         // 00      --> T1GSS timer1 gate select: gate pin
-    
-
-
-    //--TIMER2 --//-------------------------------------------------------------------------------------------
-
-    PR2=0xFF; //defines the PWM period (not used!)
-
-    T2CON = 0b00000001;  // 0       --> not used
-                         // 0000    --> Postscaler  1:1
-                         // 0       --> TMR2 OFF
-                         // 01      --> Prescaler set to 1:4 (with 16 Mhz clock and PR2=110 --> 9kHz PWM)
-
-    //--TIMER4 --//--------------------------------------------------------------------------------------
-
-    PR4 = 0xFF;          //defines the PWM period (not used!)
-
-    T4CON = 0b00000000;  // 0       --> not used
-                         // 0000    --> Postscaler  1:1
-                         // 0       --> TMR4 OFF
-                         // 01      --> Prescaler set to 1:4 (with 16 Mhz clock and PR2=110 --> 9kHz PWM)
-
-    //--TIMER6--//--------------------------------------------------------------------------------------
-
-    PR6 = 0xFF; //definisce a che valore avviene l'interrupt
-    T6CON = 0b00000010;  // 0       --> not used
-                         // 0000    --> Postscaler  1:1
-                         // 0       --> TMR2 OFF
-                         // 01      --> Prescaler set to 1:4 (with 16 Mhz clock and PR2=110 --> 9kHz PWM)
-    //--INTERRUPT--//--------------------------------------------------------------------------------------------------
-
-    INTCON = 0b00000000; // 0       --> Global interrupt disabled  (GIE)
-                         // 0       --> Peripheral interrupt disabled (PEIE)
-                         // 0       --> Interrupt di TMR0 disabled (TMR0IE)
-                         // 0       --> External Interrupt disabled (define in OPTION_REG if pullup or pulldown) on pin INT (RA2) (INTE)
-                         // 0       --> Interrupt on change disabled  (IOCIE)
-                         // 0       --> Flag  TMR0 Overflow (TMR0IF)
-                         // 0       --> Flag  External Interrupt (INTF)
-                         // 0       --> Flag  interrupt on change (IOCIF)
-
-    PIR1 = 0;              // Reset PIE1 interrupts flags
-    PIR2 = 0;              // Reset PIE2 interrupts flags
-    PIR3 = 0;              // Reset PIE3 interrupts flags
-
-    PIE1 = 0b00000000;     // 0       --> TMR1 Gate Interrupt disabled
-                           // 0       --> A/D converter interrupt disabled
-                           // 0       --> USART RECEIVE interrupt disabled
-                           // 0       --> USART TRANSMIT interrupt disabled
-                           // 0       --> Serial Port interrupt disabled
-                           // 0       --> CCP1 interrupt disabled
-                           // 0       --> TMR2 to PR2 Match interrupt disabled
-                           // 0       --> TMR1 overflow interrupt disabled
-
-    PIE2 = 0b00000000;     // 0       --> Oscillator fail interrupt disabled
-                           // 0       --> Interrupt comparator C2 disabled
-                           // 0       --> Interrupt comparator C1 disabled
-                           // 0       --> Interrupt EEPROM scrittura completata disabled
-                           // 0       --> Serial Port Collision interrupt disabled
-                           // 000     --> not used
-
-    PIE3 = 0b00000000;     // 00      --> not used
-                           // 0       --> Interrupt comparator C4 disabled
-                           // 0       --> Interrupt comparator C3 disabled
-                           // 0       --> Interrupt TMR6 to PR6 disabled
-                           // 0       --> not used
-                           // 0       --> TMR4 to PR4 disabled
-                           // 0       --> not used
 
+//\brief Abort
+// MOS off and board disarmed right away, from any state, without waiting for the tick (a firing goes to the lockout).
+// Measures the latency from the start of the abort tone (toneStart) and keeps the longest one in abortUsMax.
+void abortNow(void)
+{
+        unsigned int latency = 0; //microseconds since the abort tone started
+        unsigned char st = tmrRead(&state); //voted state
+
+        if(st == STATE_FIRING) //a firing aborted is a firing: lockout
+                lockoutStart();
+        else if(st != STATE_LOCKOUT)
+        {
+                tmrWrite(&state, STATE_WAITING);
+                tmrWrite(&codeNext, 0);
+        }
+        applyState(); //MOS_GATE = OFF now
+
+        TMR1_READ(latency); //@bound 2 (TMR1_READ() reads again at most once)
+        latency = U16(latency - toneStart);
+        if(latency > abortUsMax)
+                abortUsMax = latency;
 }
 
 
-//\brief Delay function
-// Input the number of desired delay milliseconds. MAX 65535.
-void delayerMs(unsigned int delay)
+//\brief Clock sync
+// Called at every edge of the link check tone, with p its period and lastCapture its time. The link band accepts
+// 4.5-5.5 kHz, but only a tone at SYNC_HZ is a reference: a period farther from US(SYNC_HZ) than INTOSC can explain
+// is skipped (the estimate goes on without its correction), SYNC_ODD_MAX of them in a row stop the tracking
+// (syncLock = 0) and the countdown is then not corrected. A single one is the capture jitter of an edge on the band
+// boundary, the period after it makes up for it. A second order loop (alpha-beta filter)
+// tracks the YodaBoard clock: the phase estimate advances by one estimated period, the error with the captured edge
+// corrects the phase by a fraction of it and the period by a smaller one. Fast gains for SYNC_LOCK periods, then
+// slow ones: the capture jitter (1 us) averages out and syncDrift settles to about 20 ppm, where INTOSC alone is
+// within 1-2%. The drift is kept when the tone ends, the phase is taken again at the start of the next one.
+void syncEdge(unsigned int p)
 {
-        unsigned int i = 0; //variabile per il ciclo for
-        
-        for(i=0;i<delay;i++) //ritardo di delay ms
-                 __delay_ms(1); 
+        int err = 0; //microseconds, captured edge minus estimated edge
+
+        syncPhase += SYNC_PERIOD_Q8 + syncDrift; //where this edge should be
+
+        if((unsigned int)(p - (US(SYNC_HZ) - SYNC_BAND_US)) > (2 * SYNC_BAND_US)) //out of the band of SYNC_HZ
+        {
+                if(syncOdd < SYNC_ODD_MAX)
+                        syncOdd++;
+                if(syncOdd == SYNC_ODD_MAX) //a link tone, but not from the crystal at SYNC_HZ
+                        syncLock = 0;
+                return;
+        }
+        syncOdd = 0;
+
+        err = S16(lastCapture - (unsigned int)(syncPhase >> 8));
+
+        if((tone != CMD_LINK) || (err > SYNC_ERR_MAX) || (err < -SYNC_ERR_MAX)) //first edge of the tone, or an edge lost
+        {
+                syncPhase = (unsigned long)lastCapture << 8;
+                syncLock = 0;
+                return;
+        }
+
+        syncError = err;
+        if(syncLock < SYNC_LOCK) //acquisition: alpha 1/4, beta 1/32
+        {
+                syncLock++;
+                syncPhase += (long)err * 64;
+                syncDrift += err * 8;
+        }
+        else //tracking: alpha 1/16, beta 1/256
+        {
+                syncPhase += (long)err * 16;
+                syncDrift += err;
+        }
+
+        if(syncDrift > SYNC_DRIFT_MAX)
+                syncDrift = SYNC_DRIFT_MAX;
+        else if(syncDrift < -SYNC_DRIFT_MAX)
+                syncDrift = -SYNC_DRIFT_MAX;
+}
+
+
+//\brief Countdown start
+// Called when a burst of the countdown tone ends in a silence while armed: tonePeriods periods of it ask to fire
+// tonePeriods * COUNT_UNIT_US after its last edge (lastCapture, captured by CCP2 to the microsecond). The tick
+// counts down to COUNT_FINAL_MS before that time, then the CCP1 compare takes over (see onTick()).
+// The wait is in YodaBoard time: it is scaled by syncDrift to TMR1 counts, so boards started by the same burst fire
+// together within the crystal of the YodaBoard, not within their INTOSC. Only a locked estimate is applied
+// (syncLock == SYNC_LOCK): without a link tone at SYNC_HZ before, the wait is left in INTOSC time.
+// A saturated tonePeriods (255), or one below COUNT_PERIODS_MIN, is not a count: the board stays armed.
+void countdownStart(void)
+{
+        unsigned long wait = 0; //microseconds from the last edge to the fire time
+        unsigned int late = 0; //microseconds already gone since the last edge (the silence detection)
+
+        if((tonePeriods == 0xFF) || (tonePeriods < COUNT_PERIODS_MIN))
+                return;
+
+        wait = tonePeriods * COUNT_UNIT_US;
+        if(syncLock == SYNC_LOCK)
+                wait += ((long)(wait / 1000) * syncDrift * 5) / 256; //wait * syncDrift / SYNC_PERIOD_Q8, without overflowing
+        TMR1_READ(late); //@bound 2 (TMR1_READ() reads again at most once)
+        late = U16(late - lastCapture);
+        tmr16Write(&fireAt, U16(lastCapture + (unsigned int)wait)); //only the low 16 bits matter: TMR1 is compared within COUNT_FINAL_MS
+        tmr16Write(&countdownMs, (unsigned int)((wait - late) / 1000) - COUNT_FINAL_MS);
+        tmrWrite(&state, STATE_COUNTDOWN);
+}
+
+
+//\brief Firing plan step
+// Adds the channels of the step due (and of the following ones with the same delay) to the fired ones, then loads
+// the CCP1 compare, flag only, with the time of the next step. The caller drives them with applyState().
+// A next step already due, or due within FIRE_STEP_MARGIN_US, would be compared a TMR1 wrap late: it is added at
+// once instead. TMR1 is read to tell: a step is in the future only up to FIRE_PLAN_SPAN_US away.
+// After the last step the compare is left as it is (releasing a hardware compare would drop the MOS gate until
+// applyState()): applyState() turns it off with the firing.
+void fireStepNext(void)
+{
+        unsigned char on = tmrRead(&channels); //channels fired so far
+        unsigned int due = 0; //delay of the step being added
+        unsigned int at = 0; //TMR1 of the next step
+        unsigned int now = 0; //TMR1 before loading it
+
+        while(fireStep < FIRE_PLAN_SIZE) //@bound 1 (FIRE_PLAN_SIZE, the steps of firePlan[])
+        {
+                due = firePlan[fireStep].delayUs;
+                on |= firePlan[fireStep++].latc;
+                if((fireStep == FIRE_PLAN_SIZE) || (firePlan[fireStep].delayUs == due))
+                        continue; //the plan is over, or the next step goes with this one
+                at = U16(fireT0 + firePlan[fireStep].delayUs);
+                TMR1_READ(now); //@bound 2 (TMR1_READ() reads again at most once)
+                if((U16(at - now) >= FIRE_STEP_MARGIN_US) && (U16(at - now) <= FIRE_PLAN_SPAN_US))
+                {
+                        CCP1_LOAD(at);
+                        CCP1_CLEAR();
+                        CCP1CON = 0b00001010; //compare, flag only
+                        break;
+                }
+                //already due, or too close to load: added now, with the step before
+        }
+        tmrWrite(&channels, on);
+}
+
+
+//\brief Firing start
+// Input the TMR1 time the MOS gate goes on at. Every firing starts here, then the state goes to STATE_FIRING and
+// applyState() turns on the gate with the first step of firePlan[].
+void fireStart(unsigned int t)
+{
+        fireT0 = t;
+        fireStep = 0;
+        tmrWrite(&channels, 0);
+        fireStepNext();
+        tmrWrite(&state, STATE_FIRING);
+}
+
+
+//\brief Countdown fire
+// Called at the CCP1 compare match: TMR1 has reached fireAt. With BOARD_GATE_CCP1 the compare has already set the
+// MOS gate pin by hardware, here the state follows it; otherwise this is where the gate goes on, one pass of the
+// main loop later. The firing lasts COUNT_FIRE_MS, whatever happens to the link, then the lockout.
+void countdownFire(void)
+{
+        tmr16Write(&fireMs, COUNT_FIRE_MS);
+        fireStart(tmr16Read(&fireAt));
+        applyState(); //MOS_GATE = ON
+}
+
+
+//\brief Compare match
+// TMR1 reached CCPR1: the end of the countdown, or the next step of the firing plan.
+void onCompare(void)
+{
+        unsigned char st = tmrRead(&state); //voted state
+
+        if(st == STATE_COUNTDOWN)
+                countdownFire();
+        else if((st == STATE_FIRING) && (fireStep < FIRE_PLAN_SIZE))
+        {
+                fireStepNext();
+                applyState(); //the channels of the step on now
+        }
+}
+
+
+//\brief Rising edge on RA5
+// Input the microseconds since the previous edge. Consecutive periods of the same band make a tone, toneUs adds
+// them up. A new tone starts at its second period: a single period of another band (the one straddling a tone
+// change, or a glitch) waits in toneOdd, it is counted in the running tone if that goes on.
+// About 60 cycles (15us) plus toneEnd() or syncEdge() (~50 cycles): it must end well within the shortest period
+// (182us, top of the link band).
+// The abort is decided here, at its ABORT_PERIODS-th period: the latency is at most ABORT_PERIODS periods of
+// 303us, plus the period the tone started in, plus one pass of the main loop (onTick(), ~60us).
+void onEdge(unsigned int p)
+{
+        unsigned char cmd = classify(p); //band of this period
+
+        if(cmd == CMD_LINK) //before tone changes: the first link edge takes the phase
+                syncEdge(p);
+
+        if(cmd == tone)
+        {
+                if(toneUs < TONE_US_MAX) //saturating, longer than any hold needed (periods are < SILENCE_MS)
+                        toneUs += toneOddUs + p; //a single odd period between two of the tone was a glitch of it
+                if(tonePeriods != 0xFF)
+                        tonePeriods++;
+                if((toneOddUs != 0) && (tonePeriods != 0xFF))
+                        tonePeriods++;
+                toneOddUs = 0;
+        }
+        else if((toneOddUs != 0) && (cmd == toneOdd)) //two periods of a new band: the previous tone is over
+        {
+                toneQuiet = (toneUs == 0); //after a silence toneUs is 0, after any period it isn't
+                toneEnd();
+                tone = cmd;
+                toneUs = toneOddUs + p;
+                tonePeriods = 2;
+                toneStart = U16(lastCapture - toneUs);
+                toneOddUs = 0;
+        }
+        else //a single period of another band: not a tone yet
+        {
+                toneOdd = cmd;
+                toneOddUs = p;
+        }
+
+        if((tone == CMD_ABORT) && (tonePeriods == ABORT_PERIODS))
+                abortNow();
+}
+
+
+//\brief 1 ms tick
+// Silence detection, arm window, firing and link check decisions, then the outputs.
+void onTick(void)
+{
+        unsigned int now = 0; //TMR1 when a firing starts or the compare is loaded
+        unsigned int ms = 0; //voted countdown, firing, lockout or arm window time left
+        unsigned int at = 0; //voted fire time
+
+        if(silenceMs < SILENCE_MS)
+                silenceMs++;
+        else if(captureValid == TRUE) //no edge for SILENCE_MS: the tone is over, the next edge starts a new period
+        {
+                captureValid = FALSE;
+                if((tone == CMD_COUNT) && (toneQuiet == TRUE) && (tmrRead(&state) == STATE_ARMED)) //a whole burst, silence on both sides
+                        countdownStart();
+                else
+                        toneEnd();
+                tone = CMD_NONE;
+                toneUs = 0;
+                toneOddUs = 0; //a single period before the silence is no tone
+        }
+
+        switch(tmrRead(&state))
+        {
+            case STATE_FIRING: //toneEnd() or abortNow() end it, or the time of a countdown firing
+                ms = tmr16Read(&fireMs);
+                if(ms != 0)
+                {
+                        tmr16Write(&fireMs, --ms);
+                        if(ms == 0)
+                                lockoutStart();
+                }
+                break;
+
+            case STATE_COUNTDOWN: //abortNow() ends it
+                ms = tmr16Read(&countdownMs);
+                if(ms != 0)
+                {
+                        tmr16Write(&countdownMs, --ms);
+                        if(ms == 0) //COUNT_FINAL_MS to go: the compare takes over
+                        {
+                                at = tmr16Read(&fireAt);
+                                TMR1_READ(now); //@bound 2 (TMR1_READ() reads again at most once)
+                                if(U16(at - now) > (COUNT_FINAL_MS + 2) * 1000U) //the 16 bit compare would match a wrong time: drop the countdown
+                                        tmrWrite(&state, STATE_WAITING);
+                                else
+                                {
+                                        CCP1_LOAD(at);
+                                        CCP1_CLEAR();
+                                        CCP1CON = (BOARD_GATE_CCP1 && (firePlan[0].latc == 0)) ? 0b00001000 : 0b00001010; //compare, set the CCP1 pin on match / flag only (the channels go on with the gate)
+                                }
+                        }
+                }
+                break;
+
+            case STATE_LOCKOUT:
+                ms = tmr16Read(&lockoutMs);
+                if((ms <= 1) || (ms > LOCKOUT_MS)) //lockout over, listening again (or upset out of it)
+                {
+                        tmrWrite(&state, STATE_WAITING);
+                        INPUT_OPEN();
+                }
+                else
+                        tmr16Write(&lockoutMs, ms - 1);
+                break;
+
+            case STATE_ARMED:
+                if((tone == CMD_IGNITION) && (toneUs >= IGNITE_HOLD_US))
+                {
+                        tmr16Write(&fireMs, 0); //it lasts as the tone
+                        TMR1_READ(now); //@bound 2 (TMR1_READ() reads again at most once)
+                        fireStart(now);
+                }
+                else
+                {
+                        ms = tmr16Read(&armMs);
+                        if((ms <= 1) || (ms > ARM_WINDOW_MS)) //the arm window is over without an ignition (or upset out of it)
+                                tmrWrite(&state, STATE_WAITING);
+                        else
+                                tmr16Write(&armMs, ms - 1);
+                }
+                break;
+
+            default: //waiting or link check (or an unknown value)
+                if(tone == CMD_LINK)
+                {
+                        tmrWrite(&state, STATE_LINK);
+                        if(++linkMs >= LINK_BLINK_MS) //when link checking, this led blinks like a heartbeat (constantly on means only that the board is powered on!)
+                        {
+                                linkMs = 0;
+                                LED_LINK = ~LED_LINK;
+                        }
+                }
+                else //if it's none of the above, I'm just waiting for connection
+                        tmrWrite(&state, STATE_WAITING);
+                break;
+        }
+
+        applyState();
+}
+
+
+//\brief Program memory read
+// Input the word address, returns the 14 bit word stored there.
+unsigned int flashRead(unsigned int addr)
+{
+        unsigned int word = 0; //word read
+
+        EEADRL = addr; //address low byte
+        EEADRH = addr >> 8; //address high byte
+        EECON1 = 0b10000000; // 1  --> EEPGD program memory
+                             // 0  --> CFGS program memory, not configuration
+                             // 0  --> RD not started yet
+        EECON1bits.RD = SET; //starting the read, the core stalls for two cycles
+        NOP(); //the two instructions after RD are ignored
+        NOP();
+
+        word = EEDATH;
+        word = ((word<<8)|(EEDATL));
+        return word;
+}
+
+
+//\brief Program memory checksum
+// Input the first word and the number of words, returns the sum of their low and high bytes.
+// It's the same additive checksum the linker computes on the hex file, so chunks can be added together.
+unsigned int flashSum(unsigned int first, unsigned int count)
+{
+        unsigned int sum = 0; //running sum
+        unsigned int word = 0; //last word read
+
+        while(count--) //@bound 819 (FLASH_CHUNK)
+        {
+                word = flashRead(first++);
+                sum += (word & 0xFF) + (word >> 8);
+        }
+        return sum;
+}
+
+
+//\brief RAM stuck-bit test
+// Writes 0x55 and 0xAA in every banked RAM byte, reads them back and restores the original content.
+// The only state is kept in core registers (FSR0 = address under test, FSR1L = saved byte), so it can run on RAM
+// that is in use without corrupting it. Common RAM (0x70-0x7F) is not in the linear map and is not tested.
+// Returns FALSE at the first failing byte (left as it is). Takes about 2ms.
+unsigned char ramTest(void)
+{
+        FSR0H = RAM_BANK_H;
+        FSR0L = 0;
+        do
+        {
+                FSR1L = INDF0; //saving the byte under test
+                INDF0 = 0x55;
+                if(INDF0 != 0x55)
+                        return FALSE;
+                INDF0 = 0xAA;
+                if(INDF0 != 0xAA)
+                        return FALSE;
+                INDF0 = FSR1L; //restoring it
+                FSR0L++;
+        }
+        while(FSR0L != RAM_END_L); //@bound 240 banked RAM bytes
+
+        return TRUE;
+}
+
+
+//\brief Data EEPROM read
+// Input the byte address, returns the byte stored there.
+unsigned char eepromRead(unsigned char addr)
+{
+        EEADRL = addr;
+        EECON1 = 0b00000000; // 0  --> EEPGD data memory
+                             // 0  --> CFGS data memory, not configuration
+                             // 0  --> RD not started yet
+        EECON1bits.RD = SET; //the data is in EEDATL at the next instruction
+        return EEDATL;
+}
+
+
+//\brief Board address
+// Reads the address and its complement from the data EEPROM and stores the address, triple-redundant: classify()
+// reads the bands of its row straight from addrBands[], in flash, nothing of them is copied to RAM. An erased EEPROM
+// is address 0, the single board of the line. Returns FALSE for anything else that isn't a valid address: a board
+// that doesn't know its address must not answer to any.
+unsigned char addressLoad(void)
+{
+        unsigned char addr = eepromRead(ADDR_EEPROM); //address
+        unsigned char check = eepromRead(ADDR_EEPROM + 1); //its complement
+
+        if((addr == 0xFF) && (check == 0xFF)) //never written
+                addr = 0;
+        else if(((unsigned char)(addr ^ check) != 0xFF) || (addr >= BOARD_ADDRESSES))
+                return FALSE;
+
+        tmrWrite(&address, addr);
+        return TRUE;
+}
+
+
+//\brief Self test failure
+// Never returns: the MOS gate is kept off and both leds blink together, a pattern used nowhere else.
+void selftestFail(void)
+{
+        while(TRUE)
+        {
+                MOS_GATE = OFF;
+                LED_IGNITION = ON;
+                LED_LINK = ON;
+                delayerMs(100);
+                LED_IGNITION = OFF;
+                LED_LINK = OFF;
+                delayerMs(100);
+        }
 }
 
 
@@ -337,55 +1055,65 @@ void delayerMs(unsigned int delay)
 void main(void)
  {
    unsigned int i = 0; //temp variable used in for cycle
+   unsigned int sum = 0; //program memory checksum
+   unsigned int capture = 0; //TMR1 at the edge being served
    
    init(); // initializing the system
+
+   if(ramTest() == FALSE) //RAM first, every other check relies on it
+           selftestFail();
+
+   if(addressLoad() == FALSE) //then the bands this board answers to
+           selftestFail();
          
-   for(i=0;i<5;i++) //a fast led cycle to visually check they're working at startup
+   for(i=0;i<5;i++) //a fast led cycle to visually check they're working at startup (@bound 5)
    {
            LED_IGNITION = ON;
            LED_LINK = OFF;
-           delayerMs(50);
+           sum += flashSum(i*FLASH_CHUNK, FLASH_CHUNK); //the flash check runs while the leds are on display
+           delayerMs(50 - FLASH_CHUNK_MS);
            LED_IGNITION = OFF;
            LED_LINK = ON;
            delayerMs(50);
    }
+
+#ifndef __DEBUG //the debugger executive sits at the top of the flash, the reference word is valid only in production
+   if((sum & 0x3FFF) != flashRead(FLASH_SUM_ADDR)) //the high byte of a program word has only 6 bits
+           selftestFail();
+#endif
    
-   TMR1H = 0; //resetting the TMR1 values (it's a 16 bit number, in two registers!)
-   TMR1L = 0;
-  
-   INPUT_DISABLE=OFF; //This disables the input if later we set TRIS-A4 bit to output (debug only)
+   CCP2_CLEAR(); //the edges seen during the self test are not part of any tone
+   INPUT_OPEN(); //from now on the YodaBoard signal reaches CCP2
 
-   while (TRUE) //infinite loop, almost once a second it checks the actual frequency.
+   while (TRUE) //infinite loop, serving the edges on RA5 and the tick as they come
    {
-        TMR1ON = ON; //we turn on the timer
-        delayerMs(1000); //we wait (about) a second
-        TMR1ON = OFF; //we turn off the timer
-        //TRISAbits.TRISA4=OUTPUT; //Debug only, this makes impossible for the clock to reach the TMR1 counter pin.
-            
-        freq = TMR1H; //These are the higher 8 bits
-        freq = ((freq<<8)|(TMR1L));  //we shift the higher bits by eight places up, and OR it with the lower eight. (to recover the 16bit word for easier use in code)
-        
-       if(freq>= IGNITION_MIN && freq<= IGNITION_MAX) //Checking if it's the frequency for ignition
-       {
-                LED_IGNITION = ON; //turning on the ignition led
-                LED_LINK = OFF; //turning off the link led (because is for test only)
-                MOS_GATE = ON; //Turning on the MOSFET (giving power to the spark plug)
-       }
-       else if(freq>=YODA_MIN && freq<=YODA_MAX) //if it's not for ignition, maybe it's for signal check
-       {
-            LED_IGNITION = OFF; //if it's for link check, this led should be off.
-            LED_LINK = ~LED_LINK; //when link checking, this led blinks like a heartbeat (constantly on means only that the board is powered on!)
-            MOS_GATE = OFF; //the spark plug must be off, it's a good thing to remember it!
-       }
-       else //if it's none of the above, I'm just waiting for connection
-       {
-           LED_IGNITION = OFF; //ignition led is off because
-           MOS_GATE = OFF; //the MOSFET (and spark plug) is off
-           LED_LINK = ON; // but the led link is CONSTANTLY on, indicating that the processor is succesfully powered on and waiting.
-       }
-        TMR1H = 0; //resetting the values, for the next readings.
-        TMR1L = 0;
-       
+        HAL_POLL();
+
+        if(CCP2_EDGE()) //rising edge on RA5, CCPR2 holds the time it came at
+        {
+                CCP2_CLEAR();
+                capture = CCP2_READ();
+                period = U16(capture - lastCapture); //TMR1 wraps at 65535 like the subtraction: always right
+                lastCapture = capture;
+                if(captureValid == TRUE)
+                        onEdge(period);
+                captureValid = TRUE;
+                silenceMs = 0;
+        }
+
+        if(CCP1_MATCH()) //TMR1 reached CCPR1: countdown over or next firing step
+        {
+                CCP1_CLEAR();
+                onCompare();
+        }
+
+        if(TICK()) //1 ms tick
+        {
+                TICK_CLEAR();
+                onTick();
+        }
+
+        scrubSfr(); //every pass: a stopped tick can't stop it
    }
       
  }
\ No newline at end of file
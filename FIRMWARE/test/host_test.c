@@ -0,0 +1,950 @@
+/****************************************************************************************************************************************************************************
+ *  FILE NAME     : host_test.c
+ *  Description   : Native tests and benchmark of the Ignition Firmware, through the register model of hal_host.h
+ *  Target        : x86-64 Linux (gcc), never built for the PIC
+ *  Copyright     : SKYWARD EXPERIMENTAL ROCKETRY
+ *
+ * DESCRIPTION
+ * Runs the whole firmware (firmwareMain(), the main() of main.c) against a simulated YodaBoard: every test is a list
+ * of tone segments (duration, frequency, 0 for silence) played on RA5 from t = 600 ms, after the self test. The hook
+ * of hal_host.h turns the tone into CCP2 captures, as long as the input interlock is open, and records the MOS gate.
+ * Each test runs in its own process, so the firmware always starts from its reset state.
+ * Covered: arming code (also with symbols of odd lengths), ignite, arm window, abort (and its latency), post-fire
+ * lockout, countdown, clock sync, board addresses (and corrupt ones).
+ *
+ * With -b it benchmarks instead: host time per call of the functions of the main loop, to compare builds with each
+ * other (the cycles on the PIC are those of tools/wcet.py).
+ *
+ * With -r it replays the scenario corpus instead (test/scenarios: boot, link, ignite, abort, glitch, dropout,
+ * countdown...): the outputs of each run (MOS gate, leds, channels) are traced at every change and compared with the
+ * golden trace of test/golden. A different sequence of outputs is a behavioural diff, and fails; the same one with
+ * changes moved in time is reported as latency deltas. -R records the golden traces from the build under test, after
+ * a change of behaviour has been checked. The traces don't depend on the pins: one golden set for every revision,
+ * recorded without igniter channels (HOST_CHANNELS=0x00), a build with them differs where they go on.
+ *
+ * With -f [runs] [flip=/s] [dip=/s] [edge=/s] [stuck=chance] [drift=%] [jobs=n] it injects faults instead, in many
+ * runs at once: bit flips in the registers of faultRegs[] (T1CON, LATC, TRISC...), brown-out dips (several flips at
+ * once: BOREN_OFF, no reset), spurious edges and stuck periods of RA5, INTOSC drift. Half the runs play the arming
+ * code and the ignite tone, half a link tone only; it reports when the MOS gate went on unintended, for how long, and
+ * the firing runs that didn't fire. The register model makes the flips count: TMR1/TMR2 follow T1CON/T2CON/PR2,
+ * CCP2 captures only as ANSELA/TRISA/APFCON1/CCP2CON allow, the CCP1 compare may drive RC5 (see hal_host.c).
+ *
+ * Build and run: make host-test [HOST_BOARD_REV=30...34] [HOST_CHANNELS=0x1C], or by hand from FIRMWARE/:
+ *   gcc -I. -D__DEBUG -DBOARD_REV=33 test/host_test.c main.c hal_host.c -o host_test && ./host_test
+ * __DEBUG skips the flash checksum, the register model has no program memory.
+*/
+
+/***************************************************************************************************************
+ *                                                 LIBRARIES                                                   *
+ ***************************************************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include "hal_host.h" //register model, the same main.c sees
+#include "board.h" //MOS_GATE of the board under test
+
+/***************************************************************************************************************
+ *                                                   DEFINE                                                    *
+ ***************************************************************************************************************/
+
+#define T0_MS           600         ///> the first segment starts here, the self test is over
+#define SEGS_MAX        32          ///> segments of a test
+#define BENCH_CALLS     1000000L    ///> calls timed for each function with -b
+#define SCENARIO_DIR    "test/scenarios" ///> the corpus of -r: one .seg file per scenario
+#define GOLDEN_DIR      "test/golden" ///> its golden traces, one .trace file per scenario
+#define TRACE_DIR       "build/host" ///> traces of the build under test
+#define SCENARIO_TAIL_MS 500        ///> silence after the last segment of a scenario, unless it gives its own tail
+#define TRACE_MAX       4096        ///> output changes of a scenario
+#define TRACE_SHIFT_MAX_US 1000     ///> an output change moved by more is a behavioural diff, by less a latency delta
+#define FAULT_RUNS      200         ///> runs of -f, unless given
+#define FAULT_DIP_FLIPS 4           ///> registers a brown-out dip upsets at once
+#define FAULT_STUCK_MS  200         ///> how long RA5 stays stuck
+#define FAULT_PULSE_MAX_US 1500     ///> an unintended MOS gate pulse up to this long is repaired by the next tick (applyState()), longer fails -f
+
+//RA5 edges reach CCP2: interlock open, RA5 a digital input, CCP2 on RA5 capturing rising edges (sfrConfig[] in main.c)
+#define RA5_CAPTURED()  (TRISAbits.TRISA4 && TRISAbits.TRISA5 && !(ANSELA & 0x20) && (APFCON1 & 0x01) && ((CCP2CON & 0x0F) == 0x05))
+
+//Same codes as main.c
+#define STATE_WAITING   0x3C
+#define STATE_LOCKOUT   0x66
+#define STATE_ARMED     0xC3
+#define ADDR_EEPROM     0x00
+
+#define CHECK(cond)     do { if(!(cond)) { printf("    %s:%d: %s\n", __FILE__, __LINE__, #cond); return 0; } } while(0)
+
+//Arming code of main.c (armCode[]), 40 ms each
+#define ARM             { 40, 800 }, { 40, 2700 }, { 40, 1200 }, { 40, 1800 }
+
+/***************************************************************************************************************
+ *                                          FIRMWARE UNDER TEST                                                *
+ ***************************************************************************************************************/
+
+typedef struct { unsigned char a, b, c; } tmr8_t; //as in main.c
+
+extern tmr8_t state;
+extern tmr8_t address;
+extern unsigned int abortUsMax;
+extern int syncDrift;
+extern unsigned char sfrUpsets;
+unsigned char tmrRead(tmr8_t *v);
+unsigned char classify(unsigned int p);
+void onEdge(unsigned int p);
+void onTick(void);
+void applyState(void);
+
+/***************************************************************************************************************
+ *                                          SIMULATED YODABOARD                                                *
+ ***************************************************************************************************************/
+
+//! A piece of the signal on RA5.
+typedef struct
+{
+    double ms;                     ///> duration
+    double hz;                     ///> frequency, 0 for silence
+} seg_t;
+
+seg_t segs[SEGS_MAX]; //Segments of the test running
+unsigned long segEnd[SEGS_MAX]; //Time each one ends at (us)
+unsigned int segEdges[SEGS_MAX]; //Rising edges played in each one
+unsigned long segLastEdge[SEGS_MAX]; //Time of the last of them (us)
+int segCount = 0; //Number of segments
+unsigned long endUs = 0; //The run stops here
+double phase = 0; //Fraction of the period played so far
+unsigned long gateOnUs = 0; //First time the MOS gate went on (0 never)
+unsigned long gateOffUs = 0; //Last time it went off
+unsigned long gateLastOnUs = 0; //Last time it went on
+unsigned int gateRises = 0; //Times it went on
+unsigned char gateWas = 0; //Its level at the last delay
+unsigned char padsOn = 0; //A free pad (BOARD_FREE_LATC) went high
+unsigned long lateAtUs = 0; //The first edge from this time (0 none) is captured lateUs late, capture jitter
+unsigned int lateUs = 0;
+jmp_buf runEnd; //Way out of firmwareMain()
+
+//! An output change of the trace.
+typedef struct
+{
+    unsigned long us;              ///> time of the change
+    unsigned char gate;            ///> MOS_GATE
+    unsigned char ignition;        ///> LED_IGNITION
+    unsigned char link;            ///> LED_LINK
+    unsigned char channels;        ///> igniter channels on (LATC & BOARD_CHANNEL_LATC)
+} event_t;
+
+event_t trace[TRACE_MAX]; //Output changes of the scenario running
+int traceCount = 0; //Number of them (TRACE_MAX + 1: overflow)
+unsigned char traceOn = 0; //The hook records them
+
+//\brief Trace sample
+// Called by the hook: adds an event when an output differs from the last event.
+void traceSample(void)
+{
+    event_t e;
+
+    e.us = halHostTimeUs;
+    e.gate = MOS_GATE;
+    e.ignition = LED_IGNITION;
+    e.link = LED_LINK;
+    e.channels = LATC & BOARD_CHANNEL_LATC;
+    if(traceCount && (memcmp(&trace[traceCount - 1].gate, &e.gate, 4) == 0))
+        return;
+    if(traceCount < TRACE_MAX)
+        trace[traceCount++] = e;
+    else
+        traceCount = TRACE_MAX + 1;
+}
+
+unsigned char faultOn = 0; //The hook injects faults (-f)
+double hzScale = 1; //Tones play this much off their frequency (INTOSC drift)
+unsigned long stuckFromUs = 0; //RA5 is stuck, no edges, from here...
+unsigned long stuckToUs = 0; //...to here
+void faultStep(unsigned long us);
+
+//\brief Delay hook
+// Plays the segment the time is in: an edge every period, captured in CCPR2 like the hardware, unless the
+// interlock holds RA5 low (or a fault keeps it from CCP2). Records the MOS gate, stops the run at endUs.
+void hook(unsigned long us)
+{
+    int i = 0;
+    unsigned long cap = 0; //time the edge is captured at
+
+    while((i < segCount) && (halHostTimeUs >= segEnd[i]))
+        i++;
+
+    if((halHostTimeUs >= T0_MS * 1000UL) && (i < segCount) && (segs[i].hz > 0) && RA5_CAPTURED() &&
+       ((halHostTimeUs < stuckFromUs) || (halHostTimeUs >= stuckToUs)))
+    {
+        phase += segs[i].hz * hzScale * us / 1e6;
+        if(phase >= 1)
+        {
+            phase -= 1;
+            cap = (TMR1H << 8) | TMR1L; //CCP2 copies TMR1
+            if(lateAtUs && (halHostTimeUs >= lateAtUs))
+            {
+                cap += lateUs;
+                lateAtUs = 0;
+            }
+            CCPR2L = cap;
+            CCPR2H = cap >> 8;
+            CCP2IF = 1;
+            segEdges[i]++;
+            segLastEdge[i] = halHostTimeUs;
+        }
+    }
+    else
+        phase = 0;
+
+    if(traceOn)
+        traceSample();
+    if(faultOn)
+        faultStep(us);
+    if(MOS_GATE && !gateWas)
+    {
+        if(gateRises++ == 0)
+            gateOnUs = halHostTimeUs;
+        gateLastOnUs = halHostTimeUs;
+    }
+    if(!MOS_GATE && gateWas)
+        gateOffUs = halHostTimeUs;
+    gateWas = MOS_GATE;
+    if(LATC & BOARD_FREE_LATC)
+        padsOn = 1;
+
+    if(halHostTimeUs >= endUs)
+        longjmp(runEnd, 1);
+}
+
+
+//\brief Test run
+// Plays the segments, then tailMs of silence, with the firmware running from reset. The EEPROM is erased (address 0)
+// unless the test wrote halHostEeprom[] before.
+void run(const seg_t *s, int n, double tailMs)
+{
+    unsigned long t = T0_MS * 1000UL;
+    int i = 0;
+
+    for(i=0;i<n;i++)
+    {
+        segs[i] = s[i];
+        t += (unsigned long)(s[i].ms * 1000);
+        segEnd[i] = t;
+    }
+    segCount = n;
+    endUs = t + (unsigned long)(tailMs * 1000);
+
+    halHostOnDelay = hook;
+    if(!setjmp(runEnd))
+        firmwareMain();
+}
+
+#define RUN(tailMs, ...) do { static const seg_t s_[] = { __VA_ARGS__ }; run(s_, sizeof(s_)/sizeof(s_[0]), tailMs); } while(0)
+
+#define MS(t)           ((unsigned long)((t) * 1000) + T0_MS * 1000UL) ///> absolute time (us) of t ms after T0_MS
+
+/***************************************************************************************************************
+ *                                                 TESTS                                                       *
+ ***************************************************************************************************************/
+
+//\brief Arming code, then the ignite tone: on after IGNITE_HOLD_US, off at its end, then the lockout
+int testFire(void)
+{
+    RUN(300, ARM, { 100, 0 }, { 300, 450 });
+    CHECK(gateRises == 1);
+    CHECK((gateOnUs >= MS(300)) && (gateOnUs <= MS(305))); //260 ms of code and silence, then 40 ms of hold
+    CHECK((gateOffUs >= MS(560)) && (gateOffUs <= MS(567))); //tone over, SILENCE_MS later
+    CHECK(tmrRead(&state) == STATE_LOCKOUT);
+    CHECK(padsOn == (BOARD_CHANNEL_LATC != 0)); //the free pads fire only where the board enables channels
+    return 1;
+}
+
+//\brief Symbols that are not a whole number of periods: the period straddling each change is no tone
+int testOddSymbols(void)
+{
+    RUN(300, { 40.05, 800 }, { 40.1, 2700 }, { 40.5, 1200 }, { 39.5, 1800 }, { 100, 0 }, { 300, 450 });
+    CHECK(gateRises == 1);
+    return 1;
+}
+
+//\brief The same with 41 ms symbols, each change at another phase
+int testOddSymbols41(void)
+{
+    RUN(300, { 41, 800 }, { 41, 2700 }, { 41, 1200 }, { 41, 1800 }, { 100, 0 }, { 300, 450 });
+    CHECK(gateRises == 1);
+    return 1;
+}
+
+//\brief The ignite tone alone does nothing
+int testNoArm(void)
+{
+    RUN(300, { 300, 450 });
+    CHECK(gateRises == 0);
+    return 1;
+}
+
+//\brief The code tones in the wrong order don't arm
+int testWrongOrder(void)
+{
+    RUN(300, { 40, 800 }, { 40, 1200 }, { 40, 2700 }, { 40, 1800 }, { 100, 0 }, { 300, 450 });
+    CHECK(gateRises == 0);
+    CHECK(tmrRead(&state) == STATE_WAITING);
+    return 1;
+}
+
+//\brief After ARM_WINDOW_MS the ignite tone is ignored
+int testArmWindow(void)
+{
+    RUN(300, ARM, { 5100, 0 }, { 300, 450 });
+    CHECK(gateRises == 0);
+    return 1;
+}
+
+//\brief The abort tone disarms within ABORT_PERIODS periods, the ignite tone then does nothing
+int testAbort(void)
+{
+    RUN(300, ARM, { 100, 0 }, { 20, 3600 }, { 100, 0 }, { 300, 450 });
+    CHECK(gateRises == 0);
+    CHECK(tmrRead(&state) == STATE_WAITING);
+    CHECK((abortUsMax > 0) && (abortUsMax < 1500));
+    printf("    abort latency %u us\n", abortUsMax);
+    return 1;
+}
+
+//\brief A second arming and ignite inside LOCKOUT_MS can't fire again
+int testLockout(void)
+{
+    RUN(300, ARM, { 100, 0 }, { 300, 450 }, { 200, 0 }, ARM, { 100, 0 }, { 300, 450 });
+    CHECK(gateRises == 1);
+    CHECK(tmrRead(&state) == STATE_LOCKOUT);
+    return 1;
+}
+
+//\brief A burst of N periods fires N * 100 ms after its last edge, for COUNT_FIRE_MS, then the lockout
+int testCountdown(void)
+{
+    unsigned long due = 0;
+
+    RUN(4500, ARM, { 100, 0 }, { 9.3, 2200 });
+    due = segLastEdge[5] + (segEdges[5] - 1) * 100000UL;
+    printf("    %u periods, fired %ld us from due\n", segEdges[5] - 1, (long)gateOnUs - (long)due);
+    CHECK(gateRises == 1);
+    CHECK((gateOnUs >= due) && (gateOnUs <= due + 2 * HAL_HOST_POLL_US));
+    CHECK((gateOffUs - gateOnUs >= 1999000UL) && (gateOffUs - gateOnUs <= 2001000UL));
+    CHECK(tmrRead(&state) == STATE_LOCKOUT);
+    return 1;
+}
+
+//\brief A short burst (a few periods between two silences) is no count: no firing, the board stays armed
+int testCountdownShort(void)
+{
+    RUN(3000, ARM, { 100, 0 }, { 2.5, 2200 });
+    CHECK(gateRises == 0);
+    CHECK(tmrRead(&state) == STATE_ARMED);
+    return 1;
+}
+
+//\brief An edge of the link tone captured 8 us late (one period out of the SYNC_HZ band, the next one short) keeps the
+// lock: the countdown right after is still corrected
+int testSyncJitter(void)
+{
+    unsigned long due = 0;
+
+    lateAtUs = MS(2000);
+    lateUs = 8;
+    RUN(3000, { 2000, 4900 }, { 5, 4900 }, { 100, 0 }, ARM, { 100, 0 }, { 9.3, 2200 });
+    due = segLastEdge[8] + (segEdges[8] - 1) * 102000UL;
+    printf("    syncDrift %d, fired %ld us from due\n", syncDrift, (long)gateOnUs - (long)due);
+    CHECK(gateRises == 1);
+    CHECK((gateOnUs + 1000 >= due) && (gateOnUs <= due + 1000));
+    return 1;
+}
+
+//\brief An abort during the countdown cancels it
+int testCountdownAbort(void)
+{
+    RUN(3000, ARM, { 100, 0 }, { 9.3, 2200 }, { 500, 0 }, { 20, 3600 });
+    CHECK(gateRises == 0);
+    CHECK(tmrRead(&state) == STATE_WAITING);
+    CHECK((abortUsMax > 0) && (abortUsMax < 1500));
+    return 1;
+}
+
+//\brief A link tone 2% slow (INTOSC 2% fast) stretches the countdown by 2%
+int testSync(void)
+{
+    unsigned long due = 0;
+
+    RUN(3000, { 2000, 4900 }, { 100, 0 }, ARM, { 100, 0 }, { 9.3, 2200 });
+    due = segLastEdge[7] + (segEdges[7] - 1) * 102000UL;
+    printf("    syncDrift %d, fired %ld us from due\n", syncDrift, (long)gateOnUs - (long)due);
+    CHECK(gateRises == 1);
+    CHECK((gateOnUs + 1000 >= due) && (gateOnUs <= due + 1000));
+    return 1;
+}
+
+//\brief Board with address addr: the ignite tone of address 0 does nothing, its own fires. After the lockout, a
+// burst of 12 periods of its countdown tone fires 1.2 s later.
+int addressed(unsigned char addr, double igniteHz, double countHz)
+{
+    const seg_t s[] = { ARM, { 100, 0 }, { 100, 450 }, { 100, 0 }, { 300, igniteHz }, { 10300, 0 },
+                        ARM, { 100, 0 }, { 13.5 * 1000 / countHz, countHz } };
+    unsigned long due = 0;
+
+    halHostEeprom[ADDR_EEPROM] = addr;
+    halHostEeprom[ADDR_EEPROM + 1] = ~addr;
+    run(s, sizeof(s)/sizeof(s[0]), 4000);
+    due = segLastEdge[14] + (segEdges[14] - 1) * 100000UL;
+    printf("    %u periods, fired %ld us from due\n", segEdges[14] - 1, (long)gateLastOnUs - (long)due);
+    CHECK(tmrRead(&address) == addr);
+    CHECK(gateRises == 2);
+    CHECK(segEdges[14] - 1 == 12);
+    CHECK((gateLastOnUs >= due) && (gateLastOnUs <= due + 2 * HAL_HOST_POLL_US));
+    return 1;
+}
+
+int testAddress1(void) { return addressed(1, 660, 1470); }
+int testAddress2(void) { return addressed(2, 980, 3135); }
+int testAddress3(void) { return addressed(3, 4200, 260); }
+
+//\brief A corrupt address (complement wrong, or out of range) stops at the self test: input closed, nothing fires
+int corrupt(unsigned char addr, unsigned char check)
+{
+    halHostEeprom[ADDR_EEPROM] = addr;
+    halHostEeprom[ADDR_EEPROM + 1] = check;
+    RUN(300, ARM, { 100, 0 }, { 300, 450 });
+    CHECK(TRISAbits.TRISA4 == 0);
+    CHECK(gateRises == 0);
+    return 1;
+}
+
+int testAddressCorrupt(void) { return corrupt(1, 0x00); }
+int testAddressRange(void) { return corrupt(4, 0xFB); }
+
+/***************************************************************************************************************
+ *                                                 REGRESSION                                                  *
+ ***************************************************************************************************************/
+
+int isolated(int (*fn)(void));
+
+const char *scenario = 0; //Name of the scenario to play (file name in SCENARIO_DIR, without .seg)
+unsigned char recording = 0; //-R: its trace is the new golden one
+
+//\brief Trace line
+// Writes an event as a line of a trace file.
+void traceLine(char *s, size_t n, const event_t *e)
+{
+    snprintf(s, n, "%10lu %u %u %u %02X", e->us, e->gate, e->ignition, e->link, e->channels);
+}
+
+//\brief Trace file read
+// Reads the events of a trace file into t (at most max), returns how many or -1 if there is no such file.
+int traceRead(const char *path, event_t *t, int max)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    unsigned int g, i, l, c;
+    int n = 0;
+
+    if(!f)
+        return -1;
+    while(fgets(line, sizeof(line), f) && (n < max))
+    {
+        if(sscanf(line, "%lu %u %u %u %x", &t[n].us, &g, &i, &l, &c) != 5)
+            continue; //comment
+        t[n].gate = g;
+        t[n].ignition = i;
+        t[n].link = l;
+        t[n].channels = c;
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+//\brief Scenario run
+// Child process of -r/-R: reads SCENARIO_DIR/<scenario>.seg, plays it like a test and writes the trace, to the
+// golden file when recording. Scenario lines: "<ms> <hz>" segments (0 Hz for silence), "tail <ms>" (silence after
+// them, SCENARIO_TAIL_MS if not given), "address <n>" (EEPROM contents), # comments.
+int playScenario(void)
+{
+    seg_t s[SEGS_MAX];
+    char path[256], line[128];
+    double tail = SCENARIO_TAIL_MS, ms = 0, hz = 0;
+    unsigned int addr = 0;
+    int n = 0, i = 0;
+    FILE *f = 0;
+
+    snprintf(path, sizeof(path), "%s/%s.seg", SCENARIO_DIR, scenario);
+    if(!(f = fopen(path, "r")))
+        return 0;
+    while(fgets(line, sizeof(line), f))
+    {
+        if(sscanf(line, "tail %lf", &tail) == 1)
+            continue;
+        if(sscanf(line, "address %u", &addr) == 1)
+        {
+            halHostEeprom[ADDR_EEPROM] = addr;
+            halHostEeprom[ADDR_EEPROM + 1] = ~addr;
+            continue;
+        }
+        if((sscanf(line, "%lf %lf", &ms, &hz) == 2) && (n < SEGS_MAX))
+        {
+            s[n].ms = ms;
+            s[n].hz = hz;
+            n++;
+        }
+    }
+    fclose(f);
+
+    traceOn = 1;
+    run(s, n, tail);
+    if(traceCount > TRACE_MAX)
+        return 0;
+
+    if(recording)
+        snprintf(path, sizeof(path), "%s/%s.trace", GOLDEN_DIR, scenario);
+    else
+        snprintf(path, sizeof(path), "%s/%s.trace", TRACE_DIR, scenario);
+    if(!(f = fopen(path, "w")))
+        return 0;
+    fprintf(f, "# %s: us MOS_GATE LED_IGNITION LED_LINK channels\n", scenario);
+    for(i=0;i<traceCount;i++)
+    {
+        traceLine(line, sizeof(line), &trace[i]);
+        fprintf(f, "%s\n", line);
+    }
+    fclose(f);
+    return 1;
+}
+
+//\brief Trace compare
+// Compares the trace of the scenario with its golden one: a behavioural diff is a different sequence of outputs,
+// or an output change moved by more than TRACE_SHIFT_MAX_US; smaller moves are latency deltas, reported only.
+// Returns 1 if there is no behavioural diff.
+int traceCompare(const char *name)
+{
+    static event_t now[TRACE_MAX], gold[TRACE_MAX];
+    char path[256], a[64], b[64];
+    int n = 0, g = 0, i = 0, shifted = 0, worst = 0;
+    long d = 0, dMax = 0;
+
+    snprintf(path, sizeof(path), "%s/%s.trace", GOLDEN_DIR, name);
+    if((g = traceRead(path, gold, TRACE_MAX)) < 0)
+    {
+        printf("  no golden trace (make host-golden)\n");
+        return 0;
+    }
+    snprintf(path, sizeof(path), "%s/%s.trace", TRACE_DIR, name);
+    n = traceRead(path, now, TRACE_MAX);
+
+    for(i=0;(i<n) && (i<g);i++)
+    {
+        d = (long)now[i].us - (long)gold[i].us;
+        if((memcmp(&now[i].gate, &gold[i].gate, 4) != 0) || (labs(d) > TRACE_SHIFT_MAX_US))
+            break;
+        if(d != 0)
+            shifted++;
+        if(labs(d) > labs(dMax))
+        {
+            dMax = d;
+            worst = i;
+        }
+    }
+    if((i < n) || (i < g))
+    {
+        if(i < g)
+            traceLine(b, sizeof(b), &gold[i]);
+        else
+            strcpy(b, "(end)");
+        if(i < n)
+            traceLine(a, sizeof(a), &now[i]);
+        else
+            strcpy(a, "(end)");
+        printf("  behaviour differs at event %d of %d:\n    golden %s\n    now    %s\n", i, g, b, a);
+        return 0;
+    }
+    if(shifted)
+        printf("  same outputs, %d of %d changes moved, by up to %+ld us (event %d)\n", shifted, g, dMax, worst);
+    else
+        printf("  same outputs and times, %d changes\n", g);
+    return 1;
+}
+
+//\brief Regression run
+// Plays every scenario of SCENARIO_DIR, each in its own process, and compares its trace with the golden one
+// (record: writes the golden ones instead). Returns the number of scenarios that failed.
+int regress(unsigned char record)
+{
+    struct dirent **list = 0;
+    char name[128];
+    int n = scandir(SCENARIO_DIR, &list, 0, alphasort);
+    int i = 0, count = 0, failed = 0;
+    size_t len = 0;
+
+    recording = record;
+    printf("BOARD_REV %d, scenarios of %s %s\n", BOARD_REV, SCENARIO_DIR, record ? "recorded to " GOLDEN_DIR : "against " GOLDEN_DIR);
+    for(i=0;i<n;i++)
+    {
+        len = strlen(list[i]->d_name);
+        if((len > 4) && (len < sizeof(name)) && (strcmp(list[i]->d_name + len - 4, ".seg") == 0))
+        {
+            memcpy(name, list[i]->d_name, len - 4);
+            name[len - 4] = 0;
+            scenario = name;
+            count++;
+            printf("%-16s\n", name);
+            fflush(stdout);
+            if(!isolated(playScenario))
+            {
+                printf("  FAIL: can't play it (or over %d output changes)\n", TRACE_MAX);
+                failed++;
+            }
+            else if(record)
+                printf("  recorded\n");
+            else if(!traceCompare(name))
+                failed++;
+        }
+        free(list[i]);
+    }
+    free(list);
+    printf("%d of %d failed\n", failed, count);
+    return failed;
+}
+
+/***************************************************************************************************************
+ *                                              FAULT INJECTION                                                *
+ ***************************************************************************************************************/
+
+//! Registers a bit flip can hit: the configuration of sfrConfig[] in main.c, the ports and the compare.
+volatile unsigned char *const faultRegs[] =
+{
+    &OSCCON, &OPTION_REG, &WDTCON, &ANSELA, &ANSELC, &INLVLA, &TRISA, &TRISC, &T1CON, &PR2, &T2CON, &APFCON1,
+    &CCP2CON, &CCP1CON, &LATA, &LATC,
+};
+
+#define FAULT_REGS (sizeof(faultRegs)/sizeof(faultRegs[0])) ///> number of registers in faultRegs[]
+
+//! Fault rates of -f.
+typedef struct
+{
+    double flipHz;                 ///> single bit flips in a register of faultRegs[], per second
+    double dipHz;                  ///> brown-out dips per second: FAULT_DIP_FLIPS flips at once (BOREN_OFF: no reset)
+    double edgeHz;                 ///> spurious rising edges on RA5 per second
+    double stuck;                  ///> chance of RA5 stuck for FAULT_STUCK_MS in a run, at a random time
+    double driftPct;               ///> INTOSC off by up to this much in a run (at random): the tones play that much off
+} faultRate_t;
+
+faultRate_t faultRate = { 10, 0.2, 10, 0.5, 2 }; //Defaults of -f, its name=value arguments change them
+unsigned long long faultSeed = 1; //State of faultRandom()
+unsigned long fireFromUs = 0; //The MOS gate may go on from here...
+unsigned long fireToUs = 0; //...to here, in a firing run
+
+//! What happened in a run of -f.
+typedef struct
+{
+    unsigned char firing;          ///> the run plays the arming code and the ignite tone (else only a link tone)
+    unsigned char fired;           ///> the MOS gate went on while the ignite tone was on
+    unsigned int pulses;           ///> times the MOS gate went on outside it
+    unsigned long pulseUs;         ///> the longest of them
+    unsigned int flips, edges, dips, stuck; ///> faults injected
+    unsigned char upsets;          ///> sfrUpsets at the end: registers scrubSfr() repaired
+} faultRun_t;
+
+faultRun_t *faultRuns = 0; //Results of every run, shared with the processes that run them
+int faultRunNow = 0; //Run of this process
+unsigned long gateFromUs = 0; //The MOS gate went on out of the fire window here (0 it is not on)
+
+//\brief Fault random number, 0 to 1 (xorshift: the runs are the same on every host)
+double faultRandom(void)
+{
+    faultSeed ^= faultSeed << 13;
+    faultSeed ^= faultSeed >> 7;
+    faultSeed ^= faultSeed << 17;
+    return (faultSeed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//\brief Bit flip in a random register of faultRegs[]
+void faultFlip(void)
+{
+    int reg = (int)(faultRandom() * FAULT_REGS); //drawn one after the other: the same runs with every compiler
+    int bit = (int)(faultRandom() * 8);
+
+    *faultRegs[reg] ^= 1 << bit;
+}
+
+//\brief Fault step
+// Called by the hook with the time gone by: injects the faults due, at their rates, and watches the MOS gate. On is
+// intended only from the start of the ignite tone to SILENCE_MS after its end, in a firing run.
+void faultStep(unsigned long us)
+{
+    faultRun_t *r = &faultRuns[faultRunNow];
+    double s = us / 1e6; //seconds gone by
+    unsigned int cap = 0; //TMR1 at a spurious edge
+    int i = 0;
+
+    if(faultRandom() < faultRate.flipHz * s)
+    {
+        faultFlip();
+        r->flips++;
+    }
+    if(faultRandom() < faultRate.dipHz * s) //a dip upsets several registers at once
+    {
+        for(i=0;i<FAULT_DIP_FLIPS;i++)
+            faultFlip();
+        r->dips++;
+    }
+    if((faultRandom() < faultRate.edgeHz * s) && RA5_CAPTURED())
+    {
+        cap = (TMR1H << 8) | TMR1L;
+        CCPR2L = cap;
+        CCPR2H = cap >> 8;
+        CCP2IF = 1;
+        r->edges++;
+    }
+
+    if(MOS_GATE && r->firing && (halHostTimeUs >= fireFromUs) && (halHostTimeUs <= fireToUs))
+        r->fired = 1;
+    else if(MOS_GATE && !gateFromUs)
+    {
+        gateFromUs = halHostTimeUs;
+        r->pulses++;
+    }
+    if(gateFromUs && (!MOS_GATE || (halHostTimeUs >= endUs)))
+    {
+        if(halHostTimeUs - gateFromUs > r->pulseUs)
+            r->pulseUs = halHostTimeUs - gateFromUs;
+        gateFromUs = 0;
+    }
+}
+
+//\brief Fault run
+// Child process of -f: plays run faultRunNow, a firing or a link tone one, with its own random faults.
+int faultRun(void)
+{
+    static const seg_t firing[] = { ARM, { 100, 0 }, { 300, 450 } };
+    static const seg_t quiet[] = { { 2000, 5000 } };
+    faultRun_t *r = &faultRuns[faultRunNow];
+    double stuckMs = 0; //RA5 stuck from here (ms after T0_MS)
+
+    faultSeed = 0x9E3779B97F4A7C15ULL * (faultRunNow + 1);
+    hzScale = 1 + faultRate.driftPct / 100 * (2 * faultRandom() - 1);
+    if(faultRandom() < faultRate.stuck)
+    {
+        stuckMs = faultRandom() * 2000;
+        stuckFromUs = MS(stuckMs);
+        stuckToUs = MS(stuckMs + FAULT_STUCK_MS);
+        r->stuck = 1;
+    }
+    r->firing = faultRunNow & 1;
+    fireFromUs = MS(260);
+    fireToUs = MS(560 + 5 + 2); //the ignite tone, then SILENCE_MS
+    faultOn = 1;
+    if(r->firing)
+        run(firing, sizeof(firing)/sizeof(firing[0]), 300);
+    else
+        run(quiet, sizeof(quiet)/sizeof(quiet[0]), 300);
+    r->upsets = sfrUpsets;
+    return 1;
+}
+
+//\brief Fault injection
+// Runs faultRuns runs of faultRun(), up to jobs at once, and reports: the runs where the MOS gate went on unintended
+// (and for how long), the firing runs that didn't fire, what was injected. Returns 1 if no unintended pulse was
+// longer than FAULT_PULSE_MAX_US.
+int faults(int runs, int jobs)
+{
+    int i = 0, active = 0, quiet = 0, firing = 0, missed = 0, badRuns = 0, longRuns = 0;
+    unsigned long flips = 0, edges = 0, dips = 0, stuck = 0, upsets = 0, pulseMax = 0;
+    pid_t pid = 0;
+
+    faultRuns = mmap(0, runs * sizeof(faultRun_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(faultRuns == MAP_FAILED)
+        return 0;
+    memset(faultRuns, 0, runs * sizeof(faultRun_t));
+
+    printf("BOARD_REV %d, %d runs (%d at once): %.1f flips/s, %.1f spurious edges/s, %.2f dips/s, %.2f stuck RA5, +-%.1f%% INTOSC\n",
+           BOARD_REV, runs, jobs, faultRate.flipHz, faultRate.edgeHz, faultRate.dipHz, faultRate.stuck, faultRate.driftPct);
+    fflush(stdout);
+    for(i=0;i<runs;i++)
+    {
+        if(active == jobs)
+        {
+            wait(0);
+            active--;
+        }
+        pid = fork();
+        if(pid == 0)
+        {
+            faultRunNow = i;
+            exit(faultRun() ? 0 : 1);
+        }
+        active++;
+    }
+    while(active--)
+        wait(0);
+
+    for(i=0;i<runs;i++)
+    {
+        faultRun_t *r = &faultRuns[i];
+
+        if(r->firing)
+        {
+            firing++;
+            if(!r->fired)
+                missed++;
+        }
+        else
+            quiet++;
+        if(r->pulses)
+            badRuns++;
+        if(r->pulseUs > FAULT_PULSE_MAX_US)
+            longRuns++;
+        if(r->pulseUs > pulseMax)
+            pulseMax = r->pulseUs;
+        flips += r->flips;
+        edges += r->edges;
+        dips += r->dips;
+        stuck += r->stuck;
+        upsets += r->upsets;
+    }
+    printf("  injected: %lu bit flips, %lu dips (%d flips each), %lu spurious edges, %lu stuck RA5 (%d ms)\n",
+           flips, dips, FAULT_DIP_FLIPS, edges, stuck, FAULT_STUCK_MS);
+    printf("  scrubSfr() repaired %lu registers\n", upsets);
+    printf("  MOS gate on unintended: %d of %d runs, longest %lu us, %d runs over %d us\n",
+           badRuns, runs, pulseMax, longRuns, FAULT_PULSE_MAX_US);
+    printf("  failed to fire: %d of %d firing runs (%d link tone runs)\n", missed, firing, quiet);
+    munmap(faultRuns, runs * sizeof(faultRun_t));
+    return longRuns == 0;
+}
+
+/***************************************************************************************************************
+ *                                                 BENCHMARK                                                   *
+ ***************************************************************************************************************/
+
+//\brief Host nanoseconds per call of a function of the main loop
+double nsPerCall(void (*fn)(void))
+{
+    struct timespec a, b;
+    long i = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    for(i=0;i<BENCH_CALLS;i++)
+        fn();
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    return ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / BENCH_CALLS;
+}
+
+unsigned int benchPeriod = 0; //Period swept by the benchmarks
+volatile unsigned char benchSink = 0; //Keeps the results alive
+
+void benchClassify(void) { benchSink = classify(150 + (benchPeriod++ & 4095)); }
+void benchEdgeLink(void) { onEdge(200); }
+void benchEdgeSweep(void) { onEdge(150 + (benchPeriod++ & 4095)); }
+void benchTick(void) { onTick(); }
+void benchApply(void) { applyState(); }
+
+int bench(void)
+{
+    halHostOnDelay = 0;
+    printf("host ns per call (-O level of the build, compare builds with each other):\n");
+    printf("  classify()          %6.1f\n", nsPerCall(benchClassify));
+    printf("  onEdge() link tone  %6.1f\n", nsPerCall(benchEdgeLink));
+    printf("  onEdge() sweep      %6.1f\n", nsPerCall(benchEdgeSweep));
+    printf("  onTick()            %6.1f\n", nsPerCall(benchTick));
+    printf("  applyState()        %6.1f\n", nsPerCall(benchApply));
+    return 1;
+}
+
+/***************************************************************************************************************
+ *                                                   MAIN                                                      *
+ ***************************************************************************************************************/
+
+//! A test and its name.
+typedef struct
+{
+    const char *name;
+    int (*fn)(void);               ///> 1 passed, 0 failed
+} test_t;
+
+const test_t tests[] =
+{
+    { "fire",            testFire },
+    { "odd symbols",     testOddSymbols },
+    { "odd symbols 41",  testOddSymbols41 },
+    { "no arm",          testNoArm },
+    { "wrong order",     testWrongOrder },
+    { "arm window",      testArmWindow },
+    { "abort",           testAbort },
+    { "lockout",         testLockout },
+    { "countdown",       testCountdown },
+    { "countdown short", testCountdownShort },
+    { "countdown abort", testCountdownAbort },
+    { "sync",            testSync },
+    { "sync jitter",     testSyncJitter },
+    { "address 1",       testAddress1 },
+    { "address 2",       testAddress2 },
+    { "address 3",       testAddress3 },
+    { "address corrupt", testAddressCorrupt },
+    { "address range",   testAddressRange },
+};
+
+//\brief Runs fn in a child process, returns 1 if it passed
+int isolated(int (*fn)(void))
+{
+    int status = 0;
+    pid_t pid = fork();
+
+    if(pid == 0)
+    {
+        fflush(stdout);
+        exit(fn() ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int i = 0;
+    unsigned int failed = 0;
+
+    if((argc > 1) && (strcmp(argv[1], "-b") == 0))
+        return isolated(bench) ? 0 : 1;
+    if((argc > 1) && (strcmp(argv[1], "-r") == 0))
+        return regress(0) ? 1 : 0;
+    if((argc > 1) && (strcmp(argv[1], "-R") == 0))
+        return regress(1) ? 1 : 0;
+    if((argc > 1) && (strcmp(argv[1], "-f") == 0))
+    {
+        int runs = FAULT_RUNS, jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+        for(i=2;i<(unsigned int)argc;i++)
+        {
+            if(!sscanf(argv[i], "flip=%lf", &faultRate.flipHz) && !sscanf(argv[i], "dip=%lf", &faultRate.dipHz) &&
+               !sscanf(argv[i], "edge=%lf", &faultRate.edgeHz) && !sscanf(argv[i], "stuck=%lf", &faultRate.stuck) &&
+               !sscanf(argv[i], "drift=%lf", &faultRate.driftPct) && !sscanf(argv[i], "jobs=%d", &jobs))
+                runs = atoi(argv[i]);
+        }
+        return faults(runs, (jobs > 0) ? jobs : 1) ? 0 : 1;
+    }
+
+    printf("BOARD_REV %d\n", BOARD_REV);
+    for(i=0;i<sizeof(tests)/sizeof(tests[0]);i++)
+    {
+        printf("%-16s\n", tests[i].name);
+        fflush(stdout);
+        if(isolated(tests[i].fn))
+            printf("  pass\n");
+        else
+        {
+            printf("  FAIL\n");
+            failed++;
+        }
+    }
+    printf("%u of %u failed\n", failed, (unsigned int)(sizeof(tests)/sizeof(tests[0])));
+    return failed ? 1 : 0;
+}
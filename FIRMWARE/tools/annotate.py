@@ -0,0 +1,109 @@
+"""Source view of the hot paths: every C line with the code generated for it.
+
+Merges a source file with the PICC listing. Each line is prefixed with the
+number of instructions generated for it, their cycles for one pass, and the
+worst-case cycles the line costs per call of its function:
+
+    insns  cycles      max | source
+
+"max" multiplies every instruction by the bounds of the loops around it (the
+@bound annotations used by wcet.py); a __delay_ms() loop is charged with its
+exact count-down cycles on the line that generated it. Lines inside a loop
+without a bound are marked with '*': their "max" is for one iteration of
+that loop. Calls are counted with their own cost only, the callee
+has its own lines. With -a the generated instructions are printed under each
+line.
+
+usage: python tools/annotate.py [-a] <listing.lst> <source.c> [output]
+"""
+
+import os
+import sys
+
+import picc_lst
+import wcet
+
+
+def worst(cfg):
+    """Returns ({insn index: worst-case cycles per call of the function}, {insns inside an unbounded loop})."""
+    weight = dict((i, 1) for i in range(len(cfg.insns)))
+    unbounded = set()
+    counted = set()
+    for loop in cfg.loops:
+        if loop.counted is not None:
+            counted.update(range(loop.lo, loop.hi + 1))
+            continue
+        times = 1 if loop.bound is None else loop.bound + 1
+        for i in range(loop.lo, loop.hi + 1):
+            weight[i] *= times
+            if loop.bound is None:
+                unbounded.add(i)
+
+    cycles = {}
+    for i, insn in enumerate(cfg.insns):
+        cycles[i] = 0 if i in counted else wcet.insn_cycles(insn[2], insn[1]) * weight[i]
+    for loop in cfg.loops:
+        if loop.counted is not None:
+            cycles[loop.header] += loop.counted * weight[loop.header]   # the whole delay, on its first line
+    return cycles, unbounded
+
+
+def annotate(lst_path, source_path, asm=False):
+    functions, estimate = picc_lst.parse(lst_path)
+    analysis = wcet.Analysis(functions, os.path.dirname(source_path) or ".")
+    name = os.path.basename(source_path)
+
+    lines = {}      # source line -> [insns, cycles, max, unbounded, asm lines]
+    for func in functions.values():
+        try:
+            worst_cycles, unbounded = worst(wcet.FunctionCfg(analysis, func))
+        except wcet.Unbounded:
+            worst_cycles = dict((i, wcet.insn_cycles(insn[2], insn[1])) for i, insn in enumerate(func.insns))
+            unbounded = set(worst_cycles)
+        for i, (addr, words, op, operand, src) in enumerate(func.insns):
+            if not src or src[0] != name:
+                continue
+            cycles = wcet.insn_cycles(op, words)
+            entry = lines.setdefault(src[1], [0, 0, 0, False, []])
+            entry[0] += 1
+            entry[1] += cycles
+            entry[2] += worst_cycles[i]
+            entry[3] = entry[3] or i in unbounded
+            entry[4].append("%04X  %-8s %s" % (addr, op, operand))
+
+    out = []
+    with open(source_path) as src:
+        for n, text in enumerate(src.read().splitlines(), 1):
+            if n in lines:
+                insns, cycles, most, unbounded, code = lines[n]
+                out.append("%5d %7d %8d%s| %s" % (insns, cycles, most, "*" if unbounded else " ", text))
+                if asm:
+                    out.extend("%23s| %s" % ("", c) for c in code)
+            else:
+                out.append("%23s| %s" % ("", text))
+
+    total = sum(e[0] for e in lines.values())
+    hot = sorted(lines.items(), key=lambda item: -item[1][2])[:10]
+    out.append("")
+    out.append("%d instructions generated from %s, hottest lines (max cycles per call):" % (total, name))
+    for n, e in hot:
+        out.append("  %s:%-5d %8d%s" % (name, n, e[2], "*" if e[3] else ""))
+    return "\n".join(out) + "\n"
+
+
+def main(argv):
+    args = [a for a in argv[1:] if a != "-a"]
+    if len(args) < 2:
+        sys.stderr.write(__doc__)
+        return 2
+    text = annotate(args[0], args[1], "-a" in argv)
+    if len(args) > 2:
+        with open(args[2], "w") as out:
+            out.write(text)
+    else:
+        sys.stdout.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
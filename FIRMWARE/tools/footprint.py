@@ -0,0 +1,157 @@
+"""Flash and RAM footprint of the PICC build, compared against a stored baseline.
+
+Reads the linker map (memory ranges and psect sizes), the symbol file (start
+and __end_of_ address of every function) and the listing (global objects,
+RAM used by each function, call graph for the hardware stack) and writes the
+budget as JSON:
+
+    flash:  size, used, free and the words of every function
+    ram:    size, used, free, the bytes of every global object and the
+            params/autos/temps of every function (these share the compiled
+            stack, so they overlap and do not add up to "used")
+    stack:  hardware stack levels in use out of 16
+
+If a baseline JSON is given, every figure that changed is printed with its
+delta. To accept the current footprint as the new baseline, copy the JSON
+written by the build over the baseline file (make footprint-baseline) and
+commit it. A baseline that is given but does not exist is an error: the
+production build fails until one is committed, instead of quietly comparing
+against whatever it built first.
+
+usage: python tools/footprint.py <map> <sym> <lst> <out.json> [baseline.json]
+"""
+
+import json
+import os
+import re
+import sys
+
+import picc_lst
+import stackcheck
+
+_FLASH_CLASSES = ("CODE", "CONST", "ENTRY", "STRING", "STRCODE")
+_RAM_CLASSES = ("COMMON", "BANK0", "BANK1", "BANK2", "BIGRAM", "RAM", "ABS1")
+_RANGE_RE = re.compile(r"^([0-9A-F]+)h?-([0-9A-F]+)h?(?:x(\d+))?$", re.I)
+
+
+def _range_size(spec):
+    """Size of a linker range list like 00h-07FFhx2 or 020h-06Fh,0A0h-0EFh."""
+    size = 0
+    for part in spec.split(","):
+        m = _RANGE_RE.match(part.split("/")[0])
+        if m:
+            size += (int(m.group(2), 16) - int(m.group(1), 16) + 1) * int(m.group(3) or 1)
+    return size
+
+
+def read_map(path):
+    """Returns ({class: size} from the linker command line, {class: used} from the psect tables)."""
+    with open(path) as f:
+        text = f.read()
+    command = text.split("Object code version")[0].replace("\\\n", " ")
+    sizes = {}
+    for m in re.finditer(r"-A(\w+)=(\S+)", command):
+        sizes[m.group(1)] = _range_size(m.group(2))
+
+    used = {}
+    cls = None
+    for line in text.splitlines():
+        m = re.match(r"^\s+CLASS\s+(\w+)", line)
+        if m:
+            cls = m.group(1)
+            continue
+        if line.startswith("TOTAL") or not line.strip():
+            continue
+        if line.strip().startswith("SEGMENTS"):
+            break
+        fields = line.split()
+        if cls and len(fields) == 5:
+            used[cls] = used.get(cls, 0) + int(fields[3], 16)
+    return sizes, used
+
+
+def read_sym(path):
+    """Returns {function: words} from the _name / __end_of_name pairs of the symbol file."""
+    code = {}
+    with open(path) as f:
+        for line in f:
+            if line.startswith("%"):
+                break
+            fields = line.split()
+            if len(fields) == 4 and fields[3] == "CODE":
+                code[fields[0]] = int(fields[1], 16)
+    return dict(("_" + name[len("__end_of_"):], end - code["_" + name[len("__end_of_"):]])
+                for name, end in code.items()
+                if name.startswith("__end_of_") and "_" + name[len("__end_of_"):] in code)
+
+
+def footprint(map_path, sym_path, lst_path):
+    sizes, used = read_map(map_path)
+    functions, estimate = picc_lst.parse(lst_path)
+    stack = stackcheck.worst_case(functions, estimate)
+
+    flash_size = sizes.get("CODE", 0)
+    flash_used = sum(used.get(c, 0) for c in _FLASH_CLASSES)
+    ram_size = sizes.get("RAM", 0) + sizes.get("COMMON", 0)
+    ram_used = sum(used.get(c, 0) for c in _RAM_CLASSES)
+    return {
+        "flash": {
+            "size": flash_size,
+            "used": flash_used,
+            "free": flash_size - flash_used,
+            "functions": read_sym(sym_path),
+        },
+        "ram": {
+            "size": ram_size,
+            "used": ram_used,
+            "free": ram_size - ram_used,
+            "objects": picc_lst.objects(lst_path),
+            "functions": dict((f.name, f.ram) for f in functions.values() if f.ram is not None),
+        },
+        "stack": {
+            "size": picc_lst.STACK_LEVELS,
+            "used": stack[2] if stack else None,
+        },
+    }
+
+
+def _diff(current, baseline, path=""):
+    """Yields (path, baseline value, current value) for every number that changed."""
+    for key in sorted(set(current) | set(baseline)):
+        a, b = baseline.get(key), current.get(key)
+        name = path + "." + key if path else key
+        if isinstance(a, dict) or isinstance(b, dict):
+            for d in _diff(b or {}, a or {}, name):
+                yield d
+        elif a != b:
+            yield name, a, b
+
+
+def main(argv):
+    if len(argv) < 5:
+        sys.stderr.write(__doc__)
+        return 2
+    result = footprint(argv[1], argv[2], argv[3])
+    with open(argv[4], "w") as out:
+        json.dump(result, out, indent=2, sort_keys=True)
+        out.write("\n")
+
+    for area in ("flash", "ram", "stack"):
+        r = result[area]
+        print("footprint: %-5s %5s of %5d used" % (area, r["used"], r["size"]))
+
+    if len(argv) > 5 and not os.path.exists(argv[5]):
+        sys.stderr.write("footprint: no baseline %s: check %s, then make footprint-baseline and commit it\n"
+                         % (argv[5], argv[4]))
+        return 1
+    if len(argv) > 5:
+        with open(argv[5]) as f:
+            baseline = json.load(f)
+        for name, old, new in _diff(result, baseline):
+            delta = "%+d" % (new - old) if isinstance(old, int) and isinstance(new, int) else "changed"
+            print("footprint: %-32s %6s -> %-6s %s" % (name, old, new, delta))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
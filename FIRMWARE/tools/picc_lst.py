@@ -0,0 +1,132 @@
+"""Parser for the assembler listing (.lst) written by HI-TECH PICC.
+
+Only the parts the build checks need are read: the per-function header the
+compiler writes before each function (callers, callees, stack levels) and the
+listing lines (source line markers and instructions).
+"""
+
+import re
+
+#: hardware return stack of the PIC16F1824
+STACK_LEVELS = 16
+
+_FUNC_RE = re.compile(r";; \*+ function (\S+) \*+")
+_LEVELS_RE = re.compile(r";; Hardware stack levels (?:required when called|used):\s+(\d+)")
+_ESTIMATE_RE = re.compile(r";; Estimated maximum stack depth (\d+)")
+_LABEL_RE = re.compile(r"^\s*\d+\s+([0-9A-F]{4})\s+(\S+):\s*$")
+_INSN_RE = re.compile(r"^\s*\d+\s+([0-9A-F]{4})\s+([0-9A-F]{4})(?:\s+([0-9A-F]{4}))?\s+(\w+)\s*(.*)$")
+_SOURCE_RE = re.compile(r"^\s*;(\S+\.c): (\d+):")
+_RAM_RE = re.compile(r";;\s*Total ram usage:\s+(\d+) bytes")
+_DS_RE = re.compile(r"^\s*\d+\s+[0-9A-F]{4}\s+ds\s+(\d+)\s*$")
+
+
+class Function(object):
+    """One function block of the listing."""
+
+    def __init__(self, name):
+        self.name = name
+        self.calls = []          # callee names, from "This function calls"
+        self.called_by = []      # caller names or "Startup code after reset" / "Interrupt level N"
+        self.levels = None       # hardware stack levels reported by the compiler
+        self.ram = None          # bytes of params, autos and temps reported by the compiler
+        self.insns = []          # (address, words, mnemonic, operands, (file, line) or None)
+        self.labels = {}         # label name -> address
+
+    @property
+    def is_interrupt(self):
+        return any(c.startswith("Interrupt level") for c in self.called_by)
+
+    @property
+    def is_root(self):
+        return self.is_interrupt or any(c.startswith("Startup code") for c in self.called_by)
+
+
+def _strip(line):
+    # listing lines start with the listing line number, the function header lines start with ";;" after it
+    m = re.match(r"^\s*\d+\s(.*)$", line)
+    return m.group(1).strip() if m else line.strip()
+
+
+def parse(path):
+    """Returns (functions by name, compiler's estimated maximum stack depth or None)."""
+    functions = {}
+    estimate = None
+    current = None
+    section = None
+    source = None
+
+    with open(path) as lst:
+        for raw in lst:
+            line = raw.rstrip("\r\n")
+            text = _strip(line)
+
+            m = _ESTIMATE_RE.search(line)
+            if m:
+                estimate = int(m.group(1))
+                continue
+
+            m = _FUNC_RE.search(line)
+            if m:
+                current = functions.setdefault(m.group(1), Function(m.group(1)))
+                section = None
+                source = None
+                continue
+            if current is None:
+                continue
+
+            m = _RAM_RE.search(line)
+            if m:
+                current.ram = int(m.group(1))
+                continue
+            m = _LEVELS_RE.search(line)
+            if m:
+                current.levels = int(m.group(1))
+                section = None
+                continue
+            if text.startswith(";; This function calls:"):
+                section = current.calls
+                continue
+            if text.startswith(";; This function is called by:"):
+                section = current.called_by
+                continue
+            if text.startswith(";; This function uses") or text == ";;":
+                section = None
+                continue
+            if section is not None and text.startswith(";;"):
+                name = text[2:].strip()
+                if name and name != "Nothing":
+                    section.append(name)
+                continue
+
+            m = _SOURCE_RE.match(text)
+            if m:
+                source = (m.group(1), int(m.group(2)))
+                continue
+            m = _LABEL_RE.match(line)
+            if m:
+                current.labels[m.group(2)] = int(m.group(1), 16)
+                continue
+            m = _INSN_RE.match(line)
+            if m:
+                words = 2 if m.group(3) else 1
+                operands = m.group(5).split(";")[0].strip()
+                current.insns.append((int(m.group(1), 16), words, m.group(4).lower(), operands, source))
+
+    return functions, estimate
+
+
+def objects(path):
+    """Returns {name: bytes} of the C global objects, from the "name: ds N" lines of the data psects."""
+    sizes = {}
+    label = None
+    with open(path) as lst:
+        for line in lst:
+            m = _LABEL_RE.match(line.rstrip("\r\n"))
+            if m:
+                label = m.group(2)
+                continue
+            m = _DS_RE.match(line)
+            if m and label and label.startswith("_") and not label.startswith("__"):
+                sizes[label] = sizes.get(label, 0) + int(m.group(1))
+            label = None
+    return sizes
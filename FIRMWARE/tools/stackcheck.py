@@ -0,0 +1,65 @@
+"""Worst-case hardware stack check for the PICC build.
+
+The configuration word sets STVREN_OFF, so a stack overflow does not reset the
+PIC: it silently wraps and corrupts a return address. This script rebuilds the
+call graph from the listing, adds the levels an interrupt takes on top of the
+deepest point of main(), and fails the build if the total does not fit in the
+16 level hardware stack.
+
+usage: python tools/stackcheck.py <listing.lst> [reserve]
+
+reserve is the number of levels kept free (the debugger executive uses one).
+"""
+
+import sys
+
+import picc_lst
+
+
+def depth(functions, name, path=()):
+    """Stack levels used by the calls made from 'name' (0 for a leaf)."""
+    if name in path:
+        raise ValueError("recursion: " + " -> ".join(path + (name,)))
+    func = functions.get(name)
+    if func is None:
+        return 0        # library routine without a header in this listing, treated as a leaf
+    levels = [1 + depth(functions, callee, path + (name,)) for callee in func.calls]
+    return max(levels) if levels else 0
+
+
+def worst_case(functions, estimate):
+    """Returns (levels used by main, levels added by an interrupt, worst case), None if there is no call graph."""
+    roots = [f for f in functions.values() if f.is_root]
+    if not roots:
+        return None
+
+    # main() is entered with a jump, an interrupt pushes its return address before the ISR runs
+    mainline = max([depth(functions, f.name) for f in roots if not f.is_interrupt] or [0])
+    interrupt = max([1 + depth(functions, f.name) for f in roots if f.is_interrupt] or [0])
+    return mainline, interrupt, max(mainline + interrupt, estimate or 0)
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 2
+    reserve = int(argv[2]) if len(argv) > 2 else 0
+
+    functions, estimate = picc_lst.parse(argv[1])
+    result = worst_case(functions, estimate)
+    if result is None:
+        sys.stderr.write("stackcheck: no call graph found in %s\n" % argv[1])
+        return 2
+    mainline, interrupt, worst = result
+    limit = picc_lst.STACK_LEVELS - reserve
+
+    print("stackcheck: main %d + interrupt %d levels, worst case %d of %d (compiler estimate %s)"
+          % (mainline, interrupt, worst, limit, estimate))
+    if worst > limit:
+        sys.stderr.write("stackcheck: hardware stack can overflow (STVREN is off)\n")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
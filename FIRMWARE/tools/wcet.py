@@ -0,0 +1,300 @@
+"""Worst-case execution time of every function, from the PICC listing.
+
+Each PIC16F1 instruction is given its cycle count (1, or 2 for branches, calls,
+returns and skips that skip), the control flow graph of every function is
+rebuilt from the listing and the longest path through it is reported, callees
+included.
+
+Loops need a bound. The software delay loops PICC generates for __delay_ms()
+(nested decfsz counters preloaded with movlw/movwf) are bounded automatically
+by counting them down. Every other loop needs an annotation in the C source,
+on the line of the for/while that the listing marks for the loop:
+
+    for(i=0;i<SFR_CONFIG_SIZE;i++) //@bound 13
+
+A function containing a loop without a bound (main's while(TRUE)) is reported
+as unbounded, together with the line of the loop.
+
+usage: python tools/wcet.py <listing.lst> [source dir] [FOSC in Hz]
+"""
+
+import os
+import re
+import sys
+
+import picc_lst
+
+_TWO_CYCLES = ("goto", "bra", "brw", "call", "callw", "return", "retlw", "retfie")
+_SKIPS = ("btfsc", "btfss", "decfsz", "incfsz", "skipz", "skipnz", "skipc", "skipnc", "skipdc", "skipndc")
+_JUMPS = ("goto", "ljmp", "bra")
+_CALLS = ("call", "fcall")
+_RETURNS = ("return", "retlw", "retfie", "reset")
+_BOUND_RE = re.compile(r"@bound\s+(\d+)")
+_PCL = ("2", "PCL", "PCL&07Fh", "2,f")
+
+EXIT = -1
+SIMULATION_LIMIT = 1 << 24
+
+
+class Unbounded(Exception):
+    pass
+
+
+def insn_cycles(op, words):
+    """Cycles of one instruction, calls not included. Skips are counted as not skipping."""
+    if op in ("fcall", "ljmp"):
+        return 3 if words == 2 else 2     # pagesel (movlp) + call/goto
+    if op in _TWO_CYCLES:
+        return 2
+    return 1
+
+
+class Loop(object):
+
+    def __init__(self, header, backedges):
+        self.header = header
+        self.backedges = sorted(backedges)
+        self.lo = header
+        self.hi = self.backedges[-1]
+        self.bound = None           # iterations of the body, from an annotation
+        self.counted = None         # exact cycles of the whole loop, for decfsz delay loops
+
+    def __contains__(self, idx):
+        return self.lo <= idx <= self.hi
+
+
+class FunctionCfg(object):
+    """Control flow graph of one function, with its loops."""
+
+    def __init__(self, analysis, func):
+        self.analysis = analysis
+        self.func = func
+        self.insns = func.insns
+        self.index = {}
+        for i, insn in enumerate(self.insns):
+            for w in range(insn[1]):
+                self.index[insn[0] + w] = i
+        self.succ = [self._successors(i) for i in range(len(self.insns))]
+        self.loops = self._loops()
+
+    def where(self, i):
+        src = self.insns[i][4]
+        return "%s:%d" % src if src else "%s+0x%X" % (self.func.name, self.insns[i][0] - self.insns[0][0])
+
+    def _target(self, i, operand):
+        operand = operand.strip("()")
+        m = re.match(r"^\$([+-]\d+)$", operand)
+        if m:
+            return self.insns[i][0] + int(m.group(1))
+        if operand in self.func.labels:
+            return self.func.labels[operand]
+        return None
+
+    def _successors(self, i):
+        addr, words, op, operand, src = self.insns[i]
+        nxt = i + 1 if i + 1 < len(self.insns) else EXIT
+        if op in _RETURNS:
+            return []
+        if op in ("brw", "callw") or (op in ("movwf", "addwf") and operand in _PCL):
+            raise Unbounded("computed jump at %s" % self.where(i))
+        if op in _JUMPS:
+            target = self._target(i, operand)
+            if target is None:
+                return []       # jump to another function, it returns for us (see cost())
+            if target not in self.index:
+                raise Unbounded("jump out of %s at %s" % (self.func.name, self.where(i)))
+            return [(self.index[target], 0)]
+        if op in _SKIPS:
+            skipped = self.index.get(addr + words + self.insns[nxt][1]) if nxt != EXIT else None
+            return [(nxt, 0), (EXIT if skipped is None else skipped, 1)]
+        return [(nxt, 0)]
+
+    def cost(self, i):
+        addr, words, op, operand, src = self.insns[i]
+        cycles = insn_cycles(op, words)
+        if op in _CALLS or (op in _JUMPS and self._target(i, operand) is None):
+            cycles += self.analysis.wcet(operand.strip("()"))
+        return cycles
+
+    def _loops(self):
+        backedges = {}
+        for i, succ in enumerate(self.succ):
+            for s, extra in succ:
+                if isinstance(s, int) and s != EXIT and s <= i:
+                    backedges.setdefault(s, []).append(i)
+        loops = [Loop(h, b) for h, b in backedges.items()]
+        for a in loops:
+            for b in loops:
+                if a is not b and a.lo < b.lo <= a.hi < b.hi:
+                    raise Unbounded("overlapping loops at %s and %s" % (self.where(a.lo), self.where(b.lo)))
+            a.counted = self._count_down(a)
+            if a.counted is None:
+                a.bound = self._annotation(a)
+        return loops
+
+    def _annotation(self, loop):
+        for i in [loop.header] + loop.backedges:
+            src = self.insns[i][4]
+            if src:
+                m = _BOUND_RE.search(self.analysis.source_line(*src))
+                if m:
+                    return int(m.group(1))
+        return None
+
+    def _count_down(self, loop):
+        """Exact cycles of a decfsz delay loop (straight line, counters preloaded right before it), or None."""
+        for i, succ in enumerate(self.succ):
+            if i not in loop.backedges and any(s == loop.header for s, extra in succ) and i != loop.header - 1:
+                return None     # entered from somewhere else, the preloads may be skipped
+        counters = {}
+        i = loop.header - 2
+        while i >= 0 and self.insns[i][2] == "movlw" and self.insns[i + 1][2] == "movwf":
+            try:
+                counters.setdefault(self.insns[i + 1][3], int(self.insns[i][3], 0) & 0xFF)
+            except ValueError:
+                return None
+            i -= 2
+        body = range(loop.lo, loop.hi + 1)
+        for i in body:
+            op, operand = self.insns[i][2], self.insns[i][3]
+            if op == "decfsz":
+                reg = operand.split(",")[0]
+                if reg not in counters or i + 1 not in loop.backedges:
+                    return None
+            elif i in loop.backedges:
+                if self.insns[i - 1][2] != "decfsz":
+                    return None
+            elif op in _SKIPS or op in _JUMPS or op in _CALLS or op in _RETURNS:
+                return None
+        cycles = 0
+        steps = 0
+        i = loop.lo
+        while i <= loop.hi:
+            steps += 1
+            if steps > SIMULATION_LIMIT:
+                return None
+            op, operand = self.insns[i][2], self.insns[i][3]
+            if op == "decfsz":
+                reg = operand.split(",")[0]
+                counters[reg] = (counters[reg] - 1) & 0xFF
+                if counters[reg]:
+                    cycles += 1 + 2     # decfsz, then the goto back to the header
+                    i = loop.lo
+                else:
+                    cycles += 2         # decfsz skipping the goto
+                    i += 2
+            else:
+                cycles += 1
+                i += 1
+        return cycles
+
+    def _loop_at(self, i, lo, hi, current):
+        """Outermost loop containing i inside [lo, hi], other than the one being iterated."""
+        best = None
+        for loop in self.loops:
+            if loop is not current and i in loop and lo <= loop.lo and loop.hi <= hi:
+                if best is None or loop.hi - loop.lo > best.hi - best.lo:
+                    best = loop
+        return best
+
+    def longest(self, i, lo, hi, current, memo):
+        key = (i, lo, hi, id(current))
+        if key in memo:
+            if memo[key] is None:
+                raise Unbounded("unexpected cycle at %s" % self.where(i))
+            return memo[key]
+        memo[key] = None
+
+        loop = self._loop_at(i, lo, hi, current)
+        if loop is not None:
+            if loop.counted is not None:
+                cycles = loop.counted
+            elif loop.bound is None:
+                raise Unbounded("loop at %s has no @bound" % self.where(loop.backedges[-1]))
+            else:
+                iteration = self.longest(loop.header, loop.lo, loop.hi, loop, memo)
+                cycles = (loop.bound + (0 if i == loop.header else 1)) * iteration
+            after = 0
+            for j in range(loop.lo, loop.hi + 1):
+                for s, extra in self.succ[j]:
+                    if s == EXIT or not (lo <= s <= hi):
+                        continue
+                    elif s not in loop:
+                        after = max(after, extra + self.longest(s, lo, hi, current, memo))
+            memo[key] = cycles + after
+            return memo[key]
+
+        best = 0
+        for s, extra in self.succ[i]:
+            if s == EXIT or not (lo <= s <= hi):
+                best = max(best, extra)
+            elif current is not None and s == current.header and i in current.backedges:
+                best = max(best, extra)     # end of one iteration of the loop being measured
+            else:
+                best = max(best, extra + self.longest(s, lo, hi, current, memo))
+        memo[key] = self.cost(i) + best
+        return memo[key]
+
+
+class Analysis(object):
+
+    def __init__(self, functions, source_dir):
+        self.functions = functions
+        self.source_dir = source_dir
+        self.sources = {}
+        self.results = {}
+        self.active = set()
+
+    def source_line(self, name, line):
+        if name not in self.sources:
+            try:
+                with open(os.path.join(self.source_dir, name)) as src:
+                    self.sources[name] = src.read().splitlines()
+            except IOError:
+                self.sources[name] = []
+        lines = self.sources[name]
+        return lines[line - 1] if 0 < line <= len(lines) else ""
+
+    def wcet(self, name):
+        """Worst-case cycles of a call to 'name', raises Unbounded."""
+        if name in self.results:
+            if isinstance(self.results[name], Unbounded):
+                raise Unbounded("%s: %s" % (name, self.results[name]))
+            return self.results[name]
+        if name in self.active:
+            raise Unbounded("recursion through %s" % name)
+        func = self.functions.get(name)
+        if func is None or not func.insns:
+            raise Unbounded("no code for %s in the listing" % name)
+        self.active.add(name)
+        try:
+            cfg = FunctionCfg(self, func)
+            self.results[name] = cfg.longest(0, 0, len(cfg.insns) - 1, None, {})
+        except Unbounded as e:
+            self.results[name] = e
+        finally:
+            self.active.discard(name)
+        return self.wcet(name)
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 2
+    source_dir = argv[2] if len(argv) > 2 else "."
+    fosc = float(argv[3]) if len(argv) > 3 else 16e6
+
+    functions, estimate = picc_lst.parse(argv[1])
+    analysis = Analysis(functions, source_dir)
+    print("wcet: %-20s %10s %12s" % ("function", "cycles", "time"))
+    for name in sorted(functions):
+        try:
+            cycles = analysis.wcet(name)
+            print("wcet: %-20s %10d %10.1fus" % (name, cycles, cycles * 4e6 / fosc))
+        except Unbounded as e:
+            print("wcet: %-20s %10s   (%s)" % (name, "unbounded", e))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))